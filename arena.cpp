@@ -0,0 +1,52 @@
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+
+#include "arena.h"
+
+FrameArena::FrameArena(const size_t capacity) : block(capacity), overflow(), used(0), spilled(0), depth(0), stats{capacity, 0, 0, 0, 0} {
+}
+
+void FrameArena::reset() {
+	if (!overflow.empty()) { // grow once so that the next frame of the same size fits
+		block = std::vector<char>(std::max(block.size() * 2, block.size() + spilled + overflow.size() * 64));
+		overflow.clear();
+		stats.capacity = block.size();
+	}
+	used = spilled = 0;
+	stats.used = 0;
+	stats.frames++;
+}
+
+void* FrameArena::allocate(const size_t bytes, const size_t align) {
+	assert(align && !(align & (align - 1)));
+	uintptr_t base = reinterpret_cast<uintptr_t>(block.data());
+	uintptr_t p = (base + used + align - 1) & ~static_cast<uintptr_t>(align - 1);
+	if (p + bytes <= base + block.size()) {
+		used = p + bytes - base;
+		stats.used = used + spilled;
+		stats.high_water = std::max(stats.high_water, stats.used);
+		return reinterpret_cast<void*>(p);
+	}
+	overflow.push_back(std::vector<char>(bytes + align));
+	stats.heap_blocks++;
+	spilled += bytes + align;
+	stats.used = used + spilled;
+	stats.high_water = std::max(stats.high_water, stats.used);
+	base = reinterpret_cast<uintptr_t>(overflow.back().data());
+	return reinterpret_cast<void*>((base + align - 1) & ~static_cast<uintptr_t>(align - 1));
+}
+
+FrameArena& frame_arena() {
+	thread_local FrameArena arena;
+	return arena;
+}
+
+ArenaFrame::ArenaFrame() : arena(frame_arena()) {
+	if (!arena.depth++) arena.reset();
+}
+
+ArenaFrame::~ArenaFrame() {
+	arena.depth--;
+}
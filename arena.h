@@ -0,0 +1,42 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstdlib>
+#include <vector>
+
+typedef struct ArenaStats {
+	size_t capacity;	// bytes available without touching the heap
+	size_t used;		// bytes handed out in the current frame, overflow included
+	size_t high_water;	// largest frame so far
+	size_t frames;		// number of resets
+	size_t heap_blocks;	// overflow blocks allocated on the heap because a frame outgrew the capacity
+} ArenaStats;
+
+// Bump allocator for the transient scratch memory of a frame. Nothing is freed individually (and no
+// destructor runs, so only use it for trivially destructible types), the whole arena is rewound when
+// the outermost ArenaFrame of its thread begins. A frame larger than the capacity spills into extra
+// heap blocks, those are merged into one larger block at the next reset, so that a steady sequence
+// of frames stops calling malloc after the first one.
+typedef struct FrameArena {
+	std::vector<char> block;			// main storage
+	std::vector<std::vector<char> > overflow;	// spilled allocations of the current frame
+	size_t used, spilled;				// bytes used in block and in overflow
+	size_t depth;					// number of open ArenaFrames
+	ArenaStats stats;
+
+	FrameArena(const size_t capacity = 1 << 16);
+	void reset();
+	void* allocate(const size_t bytes, const size_t align);
+	template <typename T> T* alloc(const size_t n) { return static_cast<T*>(allocate(n * sizeof(T), alignof(T))); }
+} FrameArena;
+
+FrameArena& frame_arena(); // arena of the calling thread
+
+// delimits a frame on the arena of the calling thread, nested frames (render_view called by render) share the outermost one
+struct ArenaFrame {
+	FrameArena& arena;
+	ArenaFrame();
+	~ArenaFrame();
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <chrono>
+#include <algorithm>
+
+#include "utils.h"
+#include "render.h"
+#include "batch.h"
+#include "profile.h"
+#include "arena.h"
+
+static void write_observation(const FrameBuffer& fb, uint8_t* out) {
+	for (size_t i = 0; i < fb.w * fb.h; i++) {
+		uint8_t a;
+		unpack_color(fb.img[i], out[i * 3 + 0], out[i * 3 + 1], out[i * 3 + 2], a);
+	}
+}
+
+static void write_observation(const FrameBuffer8& fb, uint8_t* out) {
+	memcpy(out, fb.img.data(), fb.w * fb.h);
+}
+
+template <typename T> static void batch_frame(const Player& player, const ViewTables& shared_tables, const T clear_color, Map& map, SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, const Lightmap* lightmap, const size_t h, uint8_t* out) {
+	thread_local FrameBufferT<T> fb{0, 0, std::vector<T>()};
+	thread_local std::vector<RayHit> hits;
+	Player viewer = player;
+	fb.w = shared_tables.w;
+	fb.h = h;
+	fb.clear(clear_color);
+	if (viewer.fov == shared_tables.fov) {
+		render_view(fb, 0, shared_tables, hits, map, viewer, sprites, texture_walls, texture_monsters, lightmap);
+	} else {
+		ViewTables tables(fb.w, viewer.fov);
+		render_view(fb, 0, tables, hits, map, viewer, sprites, texture_walls, texture_monsters, lightmap);
+	}
+	PROFILE_SCOPE("write_observation");
+	write_observation(fb, out);
+}
+
+BatchStats render_batch(const std::vector<Player>& players, const size_t w, const size_t h, const PixelFormat format, Map& map, SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, std::vector<uint8_t>& out, size_t nthreads, const Lightmap* lightmap) {
+	const size_t channels = format == RGBA32 ? 3 : 1;
+	const size_t frame_size = w * h * channels;
+	out.resize(players.size() * frame_size);
+	if (format != RGBA32) {
+		texture_walls.convert(format);
+		texture_monsters.convert(format);
+	}
+
+	nthreads = parallel_threads(players.size(), 1, nthreads);
+
+	const float fov = players.empty() ? 0 : players[0].fov;
+	const ViewTables shared_tables(w, fov);
+	const uint32_t white = pack_color(255, 255, 255);
+	std::vector<size_t> arena_high_water(nthreads);
+
+	auto start = std::chrono::steady_clock::now();
+	parallel_chunks(players.size(), 1, nthreads, [&](const size_t t, const size_t n, size_t) {
+		if (format == RGBA32) {
+			batch_frame<uint32_t>(players[n], shared_tables, white, map, sprites, texture_walls, texture_monsters, lightmap, h, out.data() + n * frame_size);
+		} else {
+			batch_frame<uint8_t>(players[n], shared_tables, convert_color(white, format), map, sprites, texture_walls, texture_monsters, lightmap, h, out.data() + n * frame_size);
+		}
+		arena_high_water[t] = frame_arena().stats.high_water;
+	});
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	BatchStats stats{players.size(), nthreads, elapsed.count(), 0, *std::max_element(arena_high_water.begin(), arena_high_water.end())};
+	if (stats.seconds > 0) stats.fps = stats.frames / stats.seconds;
+	return stats;
+}
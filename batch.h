@@ -0,0 +1,30 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+
+#include "map.h"
+#include "utils.h"
+#include "player.h"
+#include "sprite.h"
+#include "textures.h"
+#include "lightmap.h"
+
+typedef struct BatchStats {
+	size_t frames;		// number of views rendered
+	size_t threads;		// number of worker threads used
+	double seconds;		// wall clock time of the whole batch
+	double fps;		// aggregate views per second
+	size_t arena_high_water;	// largest per-frame scratch memory of a worker, see FrameArena
+} BatchStats;
+
+// Render the first person view of every player into out, laid out as N x h x w x C uint8 with
+// C = 3 (RGB) for RGBA32 and C = 1 for GRAY8 and INDEXED8. The 8-bit formats are rendered
+// directly from 8-bit copies of the textures (converted here on first use, before the workers start).
+// All players share the map, the sprites, the textures and the per-column view tables, the frames
+// are spread over nthreads with parallel_chunks().
+BatchStats render_batch(const std::vector<Player>& players, const size_t w, const size_t h, const PixelFormat format, Map& map, SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, std::vector<uint8_t>& out, size_t nthreads = 0, const Lightmap* lightmap = nullptr);
+
+#endif
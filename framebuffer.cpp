@@ -2,16 +2,20 @@
 #include <vector>
 #include <cstdint>
 #include <cassert>
+#include <limits>
+#include <algorithm>
 
+#include "utils.h"
 #include "framebuffer.h"
 
-void FrameBuffer::set_pixel(const size_t x, const size_t y, const uint32_t color) {
+template <typename T> void FrameBufferT<T>::set_pixel(const size_t x, const size_t y, const T color) {
 	assert(img.size() == w * h && x < w && y < h);
 	img[x + y * w] = color;
 }
 
-void FrameBuffer::draw_rect(const size_t rect_x, const size_t rect_y, const size_t rect_w, const size_t rect_h, const uint32_t color) {
+template <typename T> void FrameBufferT<T>::draw_rect(const size_t rect_x, const size_t rect_y, const size_t rect_w, const size_t rect_h, const T color) {
 	assert(img.size() == w * h);
+	mark_dirty(rect_x, rect_y, rect_w, rect_h);
 	for (size_t i = 0; i < rect_w; i++) {
 		for (size_t j = 0; j < rect_h; j++) {
 			size_t cx = rect_x + i;
@@ -23,6 +27,58 @@ void FrameBuffer::draw_rect(const size_t rect_x, const size_t rect_y, const size
 	}
 }
 
-void FrameBuffer::clear(const uint32_t color) {
-	img = std::vector<uint32_t>(w * h, color);
+template <typename T> void FrameBufferT<T>::clear(const T color) {
+	img.assign(w * h, color); // keeps the storage of the previous frame
+	all_dirty = true;
+}
+
+template <typename T> void FrameBufferT<T>::mark_dirty(const size_t x, const size_t y, const size_t rect_w, const size_t rect_h) {
+	if (all_dirty || x >= w || y >= h) return;
+	dirty.push_back(Rect{x, y, std::min(rect_w, w - x), std::min(rect_h, h - y)});
+}
+
+template <typename T> void FrameBufferT<T>::clear_dirty() {
+	dirty.clear();
+	all_dirty = false;
+}
+
+template <typename T> void FrameBufferT<T>::changed(std::vector<Rect>& rects) const {
+	if (all_dirty) {
+		rects.assign(1, Rect{0, 0, w, h});
+	} else {
+		rects = dirty;
+	}
+}
+
+template struct FrameBufferT<uint32_t>;
+template struct FrameBufferT<uint8_t>;
+
+void AuxBuffers::clear() {
+	depth.assign(w * h, std::numeric_limits<float>::infinity());
+	label.assign(w * h, LABEL_NONE);
+}
+
+void AuxBuffers::set(const size_t x, const size_t y, const float d, const uint16_t l) {
+	assert(depth.size() == w * h && label.size() == w * h && x < w && y < h);
+	depth[x + y * w] = d;
+	label[x + y * w] = l;
+}
+
+void to_rgb(const FrameBuffer& fb, std::vector<uint8_t>& rgb) {
+	std::vector<Rect> rects;
+	fb.changed(rects);
+	if (rgb.size() != fb.w * fb.h * 3) {
+		rgb.resize(fb.w * fb.h * 3);
+		rects.assign(1, Rect{0, 0, fb.w, fb.h});
+	}
+	for (size_t r = 0; r < rects.size(); r++) {
+		const Rect& rect = rects[r];
+		for (size_t y = rect.y; y < rect.y + rect.h; y++) {
+			for (size_t x = rect.x; x < rect.x + rect.w; x++) {
+				uint8_t a;
+				uint8_t* p = &rgb[(x + y * fb.w) * 3];
+				unpack_color(fb.img[x + y * fb.w], p[0], p[1], p[2], a);
+			}
+		}
+	}
 }
@@ -5,13 +5,48 @@
 #include <cstdlib>
 #include <vector>
 
-typedef struct FrameBuffer {
+typedef struct Rect {
+	size_t x, y, w, h;
+} Rect;
+
+// Besides the pixels a frame buffer keeps the regions changed since the last clear_dirty(), so
+// that output conversion and streaming can skip the rest. clear() and draw_rect() mark what they
+// touch, code writing with set_pixel() marks its own region with mark_dirty(). The outputs (to_rgb,
+// QoiEncoder, StreamWriter, FrameRing) read the regions without clearing them, the owner of the
+// frame loop calls clear_dirty() once every output of the frame is done.
+template <typename T> struct FrameBufferT {
 	size_t w, h;
-	std::vector<uint32_t> img;
+	std::vector<T> img;
+	std::vector<Rect> dirty;	// changed regions, may overlap
+	bool all_dirty;			// the whole buffer changed, dirty is then irrelevant
+
+	void clear(const T color);
+	void set_pixel(const size_t x, const size_t y, const T color);
+	void draw_rect(const size_t x, const size_t y, const size_t w, const size_t h, const T color);
+	void mark_dirty(const size_t x, const size_t y, const size_t w, const size_t h);
+	void clear_dirty();
+	void changed(std::vector<Rect>& rects) const;	// the dirty regions, or the whole buffer when all_dirty
+};
+
+typedef FrameBufferT<uint32_t> FrameBuffer;	// packed RGBA pixels
+typedef FrameBufferT<uint8_t> FrameBuffer8;	// grayscale or palette indexed pixels, see PixelFormat
+
+const uint16_t LABEL_NONE = 0;		// nothing was drawn on this pixel
+const uint16_t LABEL_WALL = 0x4000;	// | wall texture id (Map::get)
+const uint16_t LABEL_SPRITE = 0x8000;	// | index of the sprite in the sprite list
+const uint16_t LABEL_FLOOR = 0x2000;	// | floor texture id
+const uint16_t LABEL_CEILING = 0x1000;	// | ceiling texture id
+
+// per-pixel auxiliary outputs of the first person view, filled by the same passes as the colors
+typedef struct AuxBuffers {
+	size_t w, h;
+	std::vector<float> depth;	// distance to the camera plane, infinity where nothing was hit
+	std::vector<uint16_t> label;	// LABEL_* | id
+
+	void clear();
+	void set(const size_t x, const size_t y, const float d, const uint16_t l);
+} AuxBuffers;
 
-	void clear(const uint32_t color);
-	void set_pixel(const size_t x, const size_t y, const uint32_t color);
-	void draw_rect(const size_t x, const size_t y, const size_t w, const size_t h, const uint32_t color);
-} FrameBuffer;
+void to_rgb(const FrameBuffer& fb, std::vector<uint8_t>& rgb); // update the 3 bytes per pixel copy rgb of fb in its dirty regions (all of it when resized)
 
 #endif
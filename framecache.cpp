@@ -0,0 +1,233 @@
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <iterator>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "framecache.h"
+
+static uint64_t fnv1a(const void* data, const size_t size, uint64_t hash = 14695981039346656037ull) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+template <typename T> static uint64_t fnv1a(const T& value, const uint64_t hash) {
+	return fnv1a(&value, sizeof(T), hash);
+}
+
+static uint64_t key_hash(const FrameKey& key) {
+	uint64_t hash = fnv1a(key.x, 14695981039346656037ull); // field by field, the padding of FrameKey is not initialized
+	hash = fnv1a(key.y, hash);
+	hash = fnv1a(key.a, hash);
+	hash = fnv1a(key.fov, hash);
+	hash = fnv1a(key.w, hash);
+	hash = fnv1a(key.h, hash);
+	hash = fnv1a(key.backend, hash);
+	hash = fnv1a(key.view_columns, hash);
+	hash = fnv1a(key.interleave, hash);
+	hash = fnv1a(key.scene, hash);
+	return fnv1a(key.pvs, hash);
+}
+
+static bool same_key(const FrameKey& a, const FrameKey& b) {
+	return a.x == b.x && a.y == b.y && a.a == b.a && a.fov == b.fov && a.w == b.w && a.h == b.h && a.backend == b.backend && a.view_columns == b.view_columns && a.interleave == b.interleave && a.scene == b.scene && a.pvs == b.pvs;
+}
+
+uint64_t scene_version(Map& map, const SpriteSet& sprites, const Lightmap* lightmap) {
+	uint64_t hash = fnv1a(map.w, 14695981039346656037ull);
+	hash = fnv1a(map.h, hash);
+	for (size_t j = 0; j < map.h; j++) {
+		for (size_t i = 0; i < map.w; i++) {
+			hash = fnv1a(map.is_empty(i, j) ? -1 : map.get(i, j), hash);
+		}
+	}
+	for (size_t d = 0; d < map.doors.size(); d++) {
+		hash = fnv1a(map.doors[d].i + map.doors[d].j * map.w, hash);
+		hash = fnv1a(map.doors[d].vertical, hash);
+		hash = fnv1a(map.doors[d].open, hash);
+	}
+	hash = fnv1a(map.floor_texture, hash);
+	hash = fnv1a(map.ceiling_texture, hash);
+	hash = fnv1a(map.fog_distance, hash);
+	hash = fnv1a(map.fog_color, hash);
+	for (size_t i = 0; i < sprites.size(); i++) {
+		hash = fnv1a(sprites.x[i], hash);
+		hash = fnv1a(sprites.y[i], hash);
+		hash = fnv1a(sprites.texture_id[i], hash);
+		hash = fnv1a(sprites.facing[i], hash);
+		hash = fnv1a(sprites.rotations[i], hash);
+	}
+	if (lightmap) {
+		hash = fnv1a(lightmap->ambient, hash);
+		for (size_t i = 0; i < lightmap->lights.size(); i++) {
+			hash = fnv1a(lightmap->lights[i].x, hash);
+			hash = fnv1a(lightmap->lights[i].y, hash);
+			hash = fnv1a(lightmap->lights[i].intensity, hash);
+			hash = fnv1a(lightmap->lights[i].radius, hash);
+		}
+	}
+	return hash;
+}
+
+FrameKey frame_key(const Player& player, const FrameBuffer& fb, const uint64_t scene, const RayBackend backend, size_t view_columns, const bool interleave, const PVS* pvs) {
+	if (!view_columns || view_columns > fb.w / 2) view_columns = fb.w / 2; // as render() does
+	uint64_t pvs_hash = 0;
+	if (pvs) {
+		pvs_hash = fnv1a(pvs->w, 14695981039346656037ull);
+		pvs_hash = fnv1a(pvs->h, pvs_hash);
+		pvs_hash = fnv1a(pvs->bits.data(), pvs->bits.size() * sizeof(uint64_t), pvs_hash);
+	}
+	return FrameKey{player.x, player.y, player.a, player.fov, static_cast<uint32_t>(fb.w), static_cast<uint32_t>(fb.h), static_cast<uint32_t>(backend), static_cast<uint32_t>(view_columns), interleave, scene, pvs_hash};
+}
+
+FrameCache::FrameCache(const size_t max_bytes, const std::string dir, const size_t max_disk_bytes) : max_bytes(max_bytes), dir(dir), max_disk_bytes(max_disk_bytes), entries(), index(), disk_scanned(false), disk(), disk_index(), stats{0, 0, 0, 0, 0, 0, 0} {
+}
+
+static std::string frame_path(const std::string& dir, const uint64_t hash) {
+	std::stringstream ss;
+	ss << dir << "/" << std::hex << std::setfill('0') << std::setw(16) << hash << ".frame";
+	return ss.str();
+}
+
+// disk file: "TRCFRM02", the FrameKey fields in order, then w * h packed colors, host byte order
+static bool read_frame(const std::string& path, const FrameKey& key, std::vector<uint32_t>& img) {
+	std::ifstream ifs(path, std::ios::binary);
+	if (!ifs) return false;
+	char magic[8];
+	FrameKey stored;
+	ifs.read(magic, 8);
+	ifs.read(reinterpret_cast<char*>(&stored.x), sizeof(float) * 4);
+	ifs.read(reinterpret_cast<char*>(&stored.w), sizeof(uint32_t) * 5);
+	ifs.read(reinterpret_cast<char*>(&stored.scene), sizeof(uint64_t));
+	ifs.read(reinterpret_cast<char*>(&stored.pvs), sizeof(uint64_t));
+	if (!ifs || memcmp(magic, "TRCFRM02", 8) || !same_key(stored, key)) return false;
+	img.resize(key.w * key.h);
+	ifs.read(reinterpret_cast<char*>(img.data()), img.size() * sizeof(uint32_t));
+	return static_cast<bool>(ifs);
+}
+
+static size_t write_frame(const std::string& path, const FrameKey& key, const std::vector<uint32_t>& img) {
+	std::ofstream ofs(path, std::ios::binary);
+	ofs.write("TRCFRM02", 8);
+	ofs.write(reinterpret_cast<const char*>(&key.x), sizeof(float) * 4);
+	ofs.write(reinterpret_cast<const char*>(&key.w), sizeof(uint32_t) * 5);
+	ofs.write(reinterpret_cast<const char*>(&key.scene), sizeof(uint64_t));
+	ofs.write(reinterpret_cast<const char*>(&key.pvs), sizeof(uint64_t));
+	ofs.write(reinterpret_cast<const char*>(img.data()), img.size() * sizeof(uint32_t));
+	return ofs ? static_cast<size_t>(ofs.tellp()) : 0;
+}
+
+// take over the frame files already in the directory, oldest first
+static void scan_disk(FrameCache& cache) {
+	cache.disk_scanned = true;
+	DIR* dir = opendir(cache.dir.c_str());
+	if (!dir) return;
+	typedef struct Found {
+		time_t mtime;
+		uint64_t hash;
+		size_t bytes;
+	} Found;
+	std::vector<Found> found;
+	for (struct dirent* entry = readdir(dir); entry; entry = readdir(dir)) {
+		const std::string name = entry->d_name;
+		struct stat st;
+		if (name.size() != 22 || name.compare(16, 6, ".frame") || name.find_first_not_of("0123456789abcdef") != 16) continue;
+		if (stat((cache.dir + "/" + name).c_str(), &st)) continue;
+		found.push_back(Found{st.st_mtime, std::stoull(name.substr(0, 16), nullptr, 16), static_cast<size_t>(st.st_size)});
+	}
+	closedir(dir);
+	std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.mtime < b.mtime || (a.mtime == b.mtime && a.hash < b.hash); });
+	for (size_t f = 0; f < found.size(); f++) {
+		cache.disk.push_back(FrameCache::DiskEntry{found[f].hash, found[f].bytes});
+		cache.disk_index[found[f].hash] = std::prev(cache.disk.end());
+		cache.stats.disk_bytes += found[f].bytes;
+	}
+}
+
+static void forget_disk(FrameCache& cache, const uint64_t hash) {
+	std::unordered_map<uint64_t, std::list<FrameCache::DiskEntry>::iterator>::iterator it = cache.disk_index.find(hash);
+	if (it == cache.disk_index.end()) return;
+	cache.stats.disk_bytes -= it->second->bytes;
+	cache.disk.erase(it->second);
+	cache.disk_index.erase(it);
+}
+
+static void insert(FrameCache& cache, const uint64_t hash, const FrameKey& key, const std::vector<uint32_t>& img) {
+	const size_t bytes = img.size() * sizeof(uint32_t);
+	if (bytes > cache.max_bytes) return;
+	while (cache.stats.bytes + bytes > cache.max_bytes) { // evict the least recently used frames
+		const FrameCache::Entry& last = cache.entries.back();
+		cache.stats.bytes -= last.img.size() * sizeof(uint32_t);
+		cache.index.erase(key_hash(last.key));
+		cache.entries.pop_back();
+		cache.stats.evictions++;
+	}
+	cache.entries.push_front(FrameCache::Entry{key, img});
+	cache.index[hash] = cache.entries.begin();
+	cache.stats.bytes += bytes;
+}
+
+bool FrameCache::get(const FrameKey& key, FrameBuffer& fb) {
+	assert(fb.w == key.w && fb.h == key.h);
+	const uint64_t hash = key_hash(key);
+	std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator it = index.find(hash);
+	if (it != index.end() && same_key(it->second->key, key)) {
+		entries.splice(entries.begin(), entries, it->second);
+		fb.img = it->second->img;
+		fb.all_dirty = true;
+		stats.hits++;
+		return true;
+	}
+	std::vector<uint32_t> img; // a truncated or foreign file must not touch fb
+	if (!dir.empty() && read_frame(frame_path(dir, hash), key, img)) {
+		fb.img.swap(img);
+		if (it == index.end()) insert(*this, hash, key, fb.img);
+		if (!disk_scanned) scan_disk(*this);
+		std::unordered_map<uint64_t, std::list<DiskEntry>::iterator>::iterator file = disk_index.find(hash);
+		if (file != disk_index.end()) disk.splice(disk.end(), disk, file->second); // most recently used now
+		utime(frame_path(dir, hash).c_str(), nullptr); // and in the next runs
+		fb.all_dirty = true;
+		stats.disk_hits++;
+		return true;
+	}
+	stats.misses++;
+	return false;
+}
+
+void FrameCache::put(const FrameKey& key, const FrameBuffer& fb) {
+	assert(fb.w == key.w && fb.h == key.h && fb.img.size() == fb.w * fb.h);
+	const uint64_t hash = key_hash(key);
+	std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator it = index.find(hash);
+	if (it != index.end()) { // replace, a colliding key loses its slot
+		stats.bytes -= it->second->img.size() * sizeof(uint32_t);
+		entries.erase(it->second);
+		index.erase(it);
+	}
+	insert(*this, hash, key, fb.img);
+	if (dir.empty()) return;
+	if (!disk_scanned) scan_disk(*this);
+	forget_disk(*this, hash); // overwritten
+	const size_t bytes = write_frame(frame_path(dir, hash), key, fb.img);
+	if (bytes) {
+		disk.push_back(DiskEntry{hash, bytes});
+		disk_index[hash] = std::prev(disk.end());
+		stats.disk_bytes += bytes;
+	}
+	while (stats.disk_bytes > max_disk_bytes && !disk.empty()) { // delete the least recently used files
+		const uint64_t oldest = disk.front().hash;
+		unlink(frame_path(dir, oldest).c_str());
+		forget_disk(*this, oldest);
+		stats.disk_evictions++;
+	}
+}
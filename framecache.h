@@ -0,0 +1,74 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+
+#include "map.h"
+#include "player.h"
+#include "sprite.h"
+#include "lightmap.h"
+#include "framebuffer.h"
+#include "raycast.h"
+#include "pvs.h"
+
+// everything a finished frame depends on besides the textures
+typedef struct FrameKey {
+	float x, y, a, fov;	// camera
+	uint32_t w, h;		// resolution
+	uint32_t backend;	// RayBackend the frame was cast with
+	uint32_t view_columns;	// columns of the view, w / 2 at full resolution
+	uint32_t interleave;	// 1 for a frame rendered with an Interleave state
+	uint64_t scene;		// scene_version() of the map, sprites and lights
+	uint64_t pvs;		// hash of the PVS the frame was culled with, 0 without
+} FrameKey;
+
+typedef struct FrameCacheStats {
+	size_t hits;		// frames served from memory
+	size_t disk_hits;	// frames served from the disk tier (and promoted to memory)
+	size_t misses;		// frames that had to be rendered
+	size_t evictions;	// frames dropped from memory to stay under max_bytes
+	size_t bytes;		// memory used by the cached pixels
+	size_t disk_evictions;	// frame files deleted to stay under max_disk_bytes
+	size_t disk_bytes;	// size of the frame files in dir
+} FrameCacheStats;
+
+uint64_t scene_version(Map& map, const SpriteSet& sprites, const Lightmap* lightmap = nullptr); // content hash of the scene
+
+// Finished frames addressed by the hash of their FrameKey: a least recently used memory tier bounded
+// by max_bytes and, if dir is not empty, a disk tier of one file per frame that persists across runs,
+// bounded by max_disk_bytes. The files found in dir are taken over by the first access, and the least
+// recently used ones (by modification time, which disk hits refresh) are deleted by put().
+typedef struct FrameCache {
+	typedef struct Entry {
+		FrameKey key;
+		std::vector<uint32_t> img;
+	} Entry;
+	typedef struct DiskEntry {
+		uint64_t hash;
+		size_t bytes;
+	} DiskEntry;
+
+	size_t max_bytes;
+	std::string dir;
+	size_t max_disk_bytes;
+	std::list<Entry> entries;	// most recently used first
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+	bool disk_scanned;		// the files of dir are in disk
+	std::list<DiskEntry> disk;	// frame files in dir, least recently used first
+	std::unordered_map<uint64_t, std::list<DiskEntry>::iterator> disk_index;
+	FrameCacheStats stats;
+
+	FrameCache(const size_t max_bytes, const std::string dir = "", const size_t max_disk_bytes = 256 << 20);
+	bool get(const FrameKey& key, FrameBuffer& fb);	// copy the cached frame into fb (all dirty), false on a miss
+	void put(const FrameKey& key, const FrameBuffer& fb);
+} FrameCache;
+
+// the key of a frame rendered by render() with these options (view_columns 0 for fb.w / 2)
+FrameKey frame_key(const Player& player, const FrameBuffer& fb, const uint64_t scene, const RayBackend backend = RAY_FLOAT, const size_t view_columns = 0, const bool interleave = false, const PVS* pvs = nullptr);
+
+#endif
@@ -0,0 +1,119 @@
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+
+#include "lightmap.h"
+
+static const int face_di[4] = {-1, 1, 0, 0}; // outward normal of every face
+static const int face_dj[4] = {0, 0, -1, 1};
+
+Lightmap::Lightmap(Map& map, const std::vector<Light>& lights, const float ambient) : w(map.w), h(map.h), ambient(ambient), lights(lights), faces(map.w * map.h * 4), floor(map.w * map.h), version(map.version) {
+	bake(map);
+}
+
+// sample point of a face (just outside of the wall) or of a floor cell (face = -1)
+static void sample_point(const size_t i, const size_t j, const int face, float& x, float& y) {
+	x = i + .5f;
+	y = j + .5f;
+	if (face >= 0) {
+		x += face_di[face] * .501f;
+		y += face_dj[face] * .501f;
+	}
+}
+
+static uint8_t sample_light(Map& map, const std::vector<Light>& lights, const float ambient, const float x, const float y, const int face) {
+	float light = ambient;
+	for (size_t l = 0; l < lights.size(); l++) {
+		float dx = lights[l].x - x;
+		float dy = lights[l].y - y;
+		float dist = std::sqrt(dx * dx + dy * dy);
+		if (dist >= lights[l].radius) continue;
+		float lambert = 1;
+		if (face >= 0) {
+			lambert = dist > 0 ? (dx * face_di[face] + dy * face_dj[face]) / dist : 1;
+			if (lambert <= 0) continue;
+		}
+		if (dist > 0) { // shadow ray from the light to the sample
+			RayHit hit = cast_ray(map, lights[l].x, lights[l].y, -dx / dist, -dy / dist, dist, true);
+			if (hit.hit) continue;
+		}
+		light += lights[l].intensity * lambert * (1 - dist / lights[l].radius);
+	}
+	return std::min(255.f, light * 255 + .5f);
+}
+
+static bool is_clear(Map& map, const int i, const int j) {
+	return i >= 0 && j >= 0 && i < static_cast<int>(map.w) && j < static_cast<int>(map.h) && map.is_clear(i, j);
+}
+
+static void bake_cell(Map& map, Lightmap& lightmap, const size_t i, const size_t j) {
+	float x, y;
+	lightmap.floor[i + j * lightmap.w] = 0;
+	if (map.is_clear(i, j)) {
+		sample_point(i, j, -1, x, y);
+		lightmap.floor[i + j * lightmap.w] = sample_light(map, lightmap.lights, lightmap.ambient, x, y, -1);
+	}
+	for (int face = 0; face < 4; face++) {
+		uint8_t& value = lightmap.faces[(i + j * lightmap.w) * 4 + face];
+		value = 0;
+		if (map.is_clear(i, j) || !is_clear(map, i + face_di[face], j + face_dj[face])) continue; // face not exposed
+		sample_point(i, j, face, x, y);
+		value = sample_light(map, lightmap.lights, lightmap.ambient, x, y, face);
+	}
+}
+
+void Lightmap::bake(Map& map) {
+	assert(map.w == w && map.h == h);
+	version = map.version;
+	for (size_t j = 0; j < h; j++) {
+		for (size_t i = 0; i < w; i++) {
+			bake_cell(map, *this, i, j);
+		}
+	}
+}
+
+void Lightmap::rebake(Map& map, const size_t ci, const size_t cj) {
+	rebake(map, MapRegion(ci, cj, ci + 1, cj + 1));
+}
+
+void Lightmap::rebake(Map& map, const MapRegion& region) {
+	assert(map.w == w && map.h == h && region.i1 <= w && region.j1 <= h);
+	if (region.empty()) return;
+	// Changed cells alter the exposure of their own faces and of their neighbours' faces, and the
+	// shadow of every sample whose ray to some light crosses them; everything else is left as is.
+	const MapRegion near(region.i0 ? region.i0 - 1 : 0, region.j0 ? region.j0 - 1 : 0, region.i1 + 1, region.j1 + 1);
+	for (size_t j = 0; j < h; j++) {
+		for (size_t i = 0; i < w; i++) {
+			bool dirty = near.contains(i, j);
+			for (int face = -1; face < 4 && !dirty; face++) {
+				float x, y;
+				sample_point(i, j, face, x, y);
+				for (size_t l = 0; l < lights.size() && !dirty; l++) {
+					dirty = region.crosses(lights[l].x, lights[l].y, x, y);
+				}
+			}
+			if (dirty) bake_cell(map, *this, i, j);
+		}
+	}
+}
+
+void Lightmap::update(Map& map) {
+	MapRegion region;
+	if (!map.changes_since(version, region)) return;
+	rebake(map, region);
+	version = map.version;
+}
+
+uint8_t Lightmap::face(const RayHit& hit) const {
+	assert(hit.hit && hit.i < w && hit.j < h);
+	if (hit.door) return floor[hit.i + hit.j * w]; // doors move, they take the light of their cell
+	int face = hit.vertical ? (hit.x < hit.i + .5f ? FACE_WEST : FACE_EAST) : (hit.y < hit.j + .5f ? FACE_NORTH : FACE_SOUTH);
+	return faces[(hit.i + hit.j * w) * 4 + face];
+}
+
+uint8_t Lightmap::cell(const size_t i, const size_t j) const {
+	assert(i < w && j < h);
+	return floor[i + j * w];
+}
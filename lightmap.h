@@ -0,0 +1,39 @@
+#ifndef LIGHTMAP_H
+#define LIGHTMAP_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+
+#include "map.h"
+#include "raycast.h"
+
+typedef struct Light {
+	float x, y;		// position
+	float intensity;	// light added at distance 0, 1 is full brightness
+	float radius;		// the light fades linearly to nothing at this distance
+} Light;
+
+// Static lighting baked at load time: one byte per wall cell face and one per floor cell, the
+// renderer reads one value per wall column and per floor pixel instead of casting shadow rays.
+// Doors are baked as open, whatever their state, so that moving them never rebakes anything.
+typedef struct Lightmap {
+	size_t w, h;			// map dimensions
+	float ambient;			// light received everywhere, shadowed or not
+	std::vector<Light> lights;
+	std::vector<uint8_t> faces;	// 4 faces (FACE_*) per cell, 0 = black, 255 = full brightness
+	std::vector<uint8_t> floor;	// 1 per cell, used for the floor, the ceiling and the sprites standing on it
+	uint64_t version;		// Map::version the light was baked for
+
+	Lightmap(Map& map, const std::vector<Light>& lights, const float ambient);
+	void bake(Map& map);					// compute every face and floor cell
+	void rebake(Map& map, const size_t i, const size_t j);	// recompute what a change of the cell (i, j) can affect
+	void rebake(Map& map, const MapRegion& region);		// recompute what a change of the cells of region can affect
+	void update(Map& map);					// rebake the cells changed since version
+	uint8_t face(const RayHit& hit) const;			// light of the wall face hit by a ray
+	uint8_t cell(const size_t i, const size_t j) const;	// light of the floor cell (i, j)
+} Lightmap;
+
+enum { FACE_WEST, FACE_EAST, FACE_NORTH, FACE_SOUTH }; // faces at x = i, x = i + 1, y = j, y = j + 1
+
+#endif
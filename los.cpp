@@ -0,0 +1,218 @@
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <limits>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "los.h"
+#include "utils.h"
+#include "profile.h"
+
+// solid bytes of the doors, which no longer block movers once fully open
+static void update_doors(LosGrid& grid) {
+	for (size_t d = 0; d < grid.doors.size(); d++) {
+		grid.solid[grid.doors[d].i + grid.doors[d].j * grid.w] = grid.doors[d].open < 1;
+	}
+}
+
+LosGrid::LosGrid(Map& map) : w(map.w), h(map.h), solid(map.w * map.h), door(map.door_at), doors(map.doors), version(map.version), door_version(map.door_version) {
+	for (size_t j = 0; j < h; j++) {
+		for (size_t i = 0; i < w; i++) {
+			solid[i + j * w] = !map.is_empty(i, j);
+		}
+	}
+	update_doors(*this);
+}
+
+void LosGrid::update(Map& map) {
+	assert(map.w == w && map.h == h);
+	MapRegion region, moved;
+	const bool edited = map.changes_since(version, region);
+	if (!edited && !map.doors_moved_since(door_version, moved)) return;
+	for (size_t j = region.j0; j < region.j1; j++) {
+		for (size_t i = region.i0; i < region.i1; i++) {
+			solid[i + j * w] = !map.is_empty(i, j);
+		}
+	}
+	if (edited) door = map.door_at; // removing a door renumbers the others
+	doors = map.doors;
+	update_doors(*this);
+	version = map.version;
+	door_version = map.door_version;
+}
+
+// Start of the walk of a query, which steps |i1 - i0| + |j1 - j0| cells from the eye's cell to the target's
+// (never overstepping an axis, so it ends exactly there) and stops at the first wall.
+typedef struct LosRay {
+	float side_x, side_y;	// segment length to the next vertical and horizontal grid lines
+	float delta_x, delta_y;	// segment length between two vertical and two horizontal grid lines
+	float len;
+	int32_t cell, step_x, step_y;	// cell index and its steps along x and y
+	int32_t left_x, left_y;	// steps left along x and y
+} LosRay;
+
+static LosRay los_ray(const LosGrid& grid, const LosQuery& q) {
+	assert(q.x0 >= 0 && q.y0 >= 0 && q.x0 < grid.w && q.y0 < grid.h && q.x1 >= 0 && q.y1 >= 0 && q.x1 < grid.w && q.y1 < grid.h);
+	const float inf = std::numeric_limits<float>::infinity();
+	const int32_t w = grid.w;
+	const int32_t i0 = q.x0, j0 = q.y0, i1 = q.x1, j1 = q.y1;
+	const float dx = q.x1 - q.x0, dy = q.y1 - q.y0;
+	LosRay ray;
+	ray.len = std::sqrt(dx * dx + dy * dy);
+	ray.delta_x = dx == 0 ? inf : ray.len / std::abs(dx);
+	ray.delta_y = dy == 0 ? inf : ray.len / std::abs(dy);
+	ray.side_x = (dx < 0 ? q.x0 - i0 : i0 + 1 - q.x0) * ray.delta_x;
+	ray.side_y = (dy < 0 ? q.y0 - j0 : j0 + 1 - q.y0) * ray.delta_y;
+	ray.cell = i0 + j0 * w;
+	ray.step_x = i1 < i0 ? -1 : 1;
+	ray.step_y = j1 < j0 ? -w : w;
+	ray.left_x = std::abs(i1 - i0);
+	ray.left_y = std::abs(j1 - j0);
+	return ray;
+}
+
+// los_ray() of the 4 queries q[0, 4), with SSE2 when available: the queries are exactly 4 floats each, so
+// one transpose gives the x0, y0, x1, y1 of all 4 and the square root and divisions are done together
+static void los_rays4(const LosGrid& grid, const LosQuery* q, LosRay* rays) {
+#ifdef __SSE2__
+	for (size_t l = 0; l < 4; l++) {
+		assert(q[l].x0 >= 0 && q[l].y0 >= 0 && q[l].x0 < grid.w && q[l].y0 < grid.h && q[l].x1 >= 0 && q[l].y1 >= 0 && q[l].x1 < grid.w && q[l].y1 < grid.h);
+	}
+	__m128 x0 = _mm_loadu_ps(&q[0].x0), y0 = _mm_loadu_ps(&q[1].x0), x1 = _mm_loadu_ps(&q[2].x0), y1 = _mm_loadu_ps(&q[3].x0);
+	_MM_TRANSPOSE4_PS(x0, y0, x1, y1);
+	const __m128i i0 = _mm_cvttps_epi32(x0), j0 = _mm_cvttps_epi32(y0), i1 = _mm_cvttps_epi32(x1), j1 = _mm_cvttps_epi32(y1);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1), inf = _mm_set1_ps(std::numeric_limits<float>::infinity()), sign = _mm_set1_ps(-0.f);
+	const __m128 dx = _mm_sub_ps(x1, x0), dy = _mm_sub_ps(y1, y0);
+	const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+	const __m128 zero_x = _mm_cmpeq_ps(dx, zero), zero_y = _mm_cmpeq_ps(dy, zero);
+	const __m128 delta_x = _mm_or_ps(_mm_and_ps(zero_x, inf), _mm_andnot_ps(zero_x, _mm_div_ps(len, _mm_andnot_ps(sign, dx))));
+	const __m128 delta_y = _mm_or_ps(_mm_and_ps(zero_y, inf), _mm_andnot_ps(zero_y, _mm_div_ps(len, _mm_andnot_ps(sign, dy))));
+	const __m128 fi0 = _mm_cvtepi32_ps(i0), fj0 = _mm_cvtepi32_ps(j0);
+	const __m128 back_x = _mm_cmplt_ps(dx, zero), back_y = _mm_cmplt_ps(dy, zero);
+	const __m128 side_x = _mm_mul_ps(_mm_or_ps(_mm_and_ps(back_x, _mm_sub_ps(x0, fi0)), _mm_andnot_ps(back_x, _mm_sub_ps(_mm_add_ps(fi0, one), x0))), delta_x);
+	const __m128 side_y = _mm_mul_ps(_mm_or_ps(_mm_and_ps(back_y, _mm_sub_ps(y0, fj0)), _mm_andnot_ps(back_y, _mm_sub_ps(_mm_add_ps(fj0, one), y0))), delta_y);
+	float lanes[5][4];
+	int32_t cells[4][4];
+	_mm_storeu_ps(lanes[0], len);
+	_mm_storeu_ps(lanes[1], delta_x);
+	_mm_storeu_ps(lanes[2], delta_y);
+	_mm_storeu_ps(lanes[3], side_x);
+	_mm_storeu_ps(lanes[4], side_y);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(cells[0]), i0);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(cells[1]), j0);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(cells[2]), i1);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(cells[3]), j1);
+	const int32_t w = grid.w;
+	for (size_t l = 0; l < 4; l++) {
+		LosRay& ray = rays[l];
+		ray.len = lanes[0][l];
+		ray.delta_x = lanes[1][l];
+		ray.delta_y = lanes[2][l];
+		ray.side_x = lanes[3][l];
+		ray.side_y = lanes[4][l];
+		ray.cell = cells[0][l] + cells[1][l] * w;
+		ray.step_x = cells[2][l] < cells[0][l] ? -1 : 1;
+		ray.step_y = cells[3][l] < cells[1][l] ? -w : w;
+		ray.left_x = std::abs(cells[2][l] - cells[0][l]);
+		ray.left_y = std::abs(cells[3][l] - cells[1][l]);
+	}
+#else
+	for (size_t l = 0; l < 4; l++) {
+		rays[l] = los_ray(grid, q[l]);
+	}
+#endif
+}
+
+// step to the next cell of the walk, t is then the distance at which the segment enters it
+static inline void los_step(LosRay& ray, float& t) {
+	if (ray.left_x > 0 && (ray.left_y == 0 || ray.side_x < ray.side_y)) {
+		t = ray.side_x;
+		ray.side_x += ray.delta_x;
+		ray.cell += ray.step_x;
+		ray.left_x--;
+	} else {
+		t = ray.side_y;
+		ray.side_y += ray.delta_y;
+		ray.cell += ray.step_y;
+		ray.left_y--;
+	}
+	PROFILE_COUNT(cells, 1);
+}
+
+// true if the segment of query crosses the closed part of the panel of door, at distance dist from the eye
+static bool door_blocks(const Door& door, const LosQuery& query, const float len, float& dist) {
+	float t, along;
+	if (!door.hit(query.x0, query.y0, query.x1 - query.x0, query.y1 - query.y0, t, along) || t > 1) return false;
+	dist = t * len;
+	return true;
+}
+
+static LosResult los_walk(const LosGrid& grid, LosRay ray, const LosQuery& query) {
+	const int32_t w = grid.w;
+	float t = 0;
+	for (;;) {
+		while (!grid.solid[ray.cell] && ray.left_x + ray.left_y > 0) {
+			los_step(ray, t);
+		}
+		if (!grid.solid[ray.cell]) return LosResult{false, ray.len, -1, -1};
+		const int32_t door = grid.door[ray.cell];
+		float dist;
+		if (door < 0) return LosResult{true, t, ray.cell % w, ray.cell / w};
+		if (door_blocks(grid.doors[door], query, ray.len, dist)) return LosResult{true, dist, ray.cell % w, ray.cell / w};
+		if (ray.left_x + ray.left_y == 0) return LosResult{false, ray.len, -1, -1};
+		los_step(ray, t); // past the open part of the door, walk on
+	}
+}
+
+LosResult line_of_sight(const LosGrid& grid, const LosQuery& query) {
+	return los_walk(grid, los_ray(grid, query), query);
+}
+
+// answer queries[0, n) into results, the rays are set up 4 at a time
+static void los_range(const LosGrid& grid, const LosQuery* queries, const size_t n, LosResult* results) {
+	LosRay rays[4];
+	size_t q = 0;
+	for (; q + 4 <= n; q += 4) {
+		los_rays4(grid, &queries[q], rays);
+		for (size_t l = 0; l < 4; l++) {
+			results[q + l] = los_walk(grid, rays[l], queries[q + l]);
+		}
+	}
+	for (; q < n; q++) {
+		results[q] = line_of_sight(grid, queries[q]);
+	}
+}
+
+void los_batch(const LosGrid& grid, const std::vector<LosQuery>& queries, std::vector<LosResult>& results, size_t nthreads, const PVS* pvs) {
+	results.resize(queries.size());
+	parallel_chunks(queries.size(), 4096, nthreads, [&](size_t, const size_t begin, const size_t end) {
+		PROFILE_SCOPE("los_chunk");
+		if (!pvs) {
+			los_range(grid, &queries[begin], end - begin, &results[begin]);
+			return;
+		}
+		thread_local std::vector<LosQuery> walked;
+		thread_local std::vector<size_t> index;
+		thread_local std::vector<LosResult> walked_results;
+		walked.clear();
+		index.clear();
+		for (size_t q = begin; q < end; q++) {
+			const LosQuery& query = queries[q];
+			if (pvs->visible_from(query.x0, query.y0, static_cast<size_t>(query.x1), static_cast<size_t>(query.y1))) {
+				walked.push_back(query);
+				index.push_back(q);
+			} else {
+				results[q] = LosResult{true, 0, -1, -1};
+			}
+		}
+		walked_results.resize(walked.size());
+		los_range(grid, walked.data(), walked.size(), walked_results.data());
+		for (size_t q = 0; q < walked.size(); q++) {
+			results[index[q]] = walked_results[q];
+		}
+	});
+}
@@ -0,0 +1,44 @@
+#ifndef LOS_H
+#define LOS_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+
+#include "map.h"
+#include "pvs.h"
+
+// Line of sight between two points of the map, for game logic running thousands of checks per tick.
+typedef struct LosQuery {
+	float x0, y0;		// eye, inside the map
+	float x1, y1;		// target, inside the map
+} LosQuery;
+
+typedef struct LosResult {
+	bool hit;		// a wall cell (the eye's and the target's included) or the closed part of a door blocks the segment
+	float dist;		// distance from the eye to where the segment enters that cell (or meets the door), the segment length if clear
+	int i, j;		// the blocking cell, -1 when clear or culled by the PVS
+} LosResult;
+
+// Wall bytes of the map in one array, queried without Map's per call checks, shared by all threads.
+// A solid door cell blocks the segments crossing the closed part of its panel only; movers
+// (see movement.h) are stopped by the whole cell until the door is fully open.
+typedef struct LosGrid {
+	size_t w, h;
+	std::vector<uint8_t> solid;	// w * h, 1 for walls and for the doors that are not fully open
+	std::vector<int32_t> door;	// w * h, index in doors or -1
+	std::vector<Door> doors;	// Map::doors when last updated
+	uint64_t version, door_version;	// Map::version and Map::door_version the cells were copied at
+
+	LosGrid(Map& map);
+	void update(Map& map);		// copy the cells changed and the doors moved since then
+} LosGrid;
+
+LosResult line_of_sight(const LosGrid& grid, const LosQuery& query);
+// Answer every query into results (resized here), with the same answers as line_of_sight(). Chunks of
+// queries are spread over nthreads with parallel_chunks() and their walks are set up 4 at a time with
+// SSE2. With a pvs, the queries whose cells are not visible from each other are
+// reported blocked without walking them (dist = 0, i = j = -1).
+void los_batch(const LosGrid& grid, const std::vector<LosQuery>& queries, std::vector<LosResult>& results, size_t nthreads = 0, const PVS* pvs = nullptr);
+
+#endif
@@ -1,6 +1,8 @@
 #include <cassert>
+#include <algorithm>
 
 #include "map.h"
+#include "utils.h"
 
 static const char map[] = "0000222222220000"\
                           "1              0"\
@@ -18,16 +20,168 @@ static const char map[] = "0000222222220000"\
                           "0 0000000      0"\
                           "0              0"\
                           "0002222222200000";
-Map::Map() : w(16), h(16) {
+
+static const size_t max_changes = 64; // a structure older than the log recomputes the whole map
+
+MapRegion::MapRegion() : i0(0), j0(0), i1(0), j1(0) {
+}
+
+MapRegion::MapRegion(const size_t i0, const size_t j0, const size_t i1, const size_t j1) : i0(i0), j0(j0), i1(i1), j1(j1) {
+}
+
+bool MapRegion::empty() const {
+	return i0 >= i1 || j0 >= j1;
+}
+
+bool MapRegion::contains(const size_t i, const size_t j) const {
+	return i >= i0 && i < i1 && j >= j0 && j < j1;
+}
+
+void MapRegion::add(const MapRegion& region) {
+	if (region.empty()) return;
+	if (empty()) {
+		*this = region;
+		return;
+	}
+	i0 = std::min(i0, region.i0);
+	j0 = std::min(j0, region.j0);
+	i1 = std::max(i1, region.i1);
+	j1 = std::max(j1, region.j1);
+}
+
+bool MapRegion::crosses(const float x0, const float y0, const float x1, const float y1) const {
+	if (empty()) return false;
+	float t0 = 0, t1 = 1;
+	const float origin[2] = {x0, y0};
+	const float delta[2] = {x1 - x0, y1 - y0};
+	const float lo[2] = {static_cast<float>(i0), static_cast<float>(j0)};
+	const float hi[2] = {static_cast<float>(i1), static_cast<float>(j1)};
+	for (int axis = 0; axis < 2; axis++) {
+		if (delta[axis] == 0) {
+			if (origin[axis] < lo[axis] || origin[axis] > hi[axis]) return false;
+			continue;
+		}
+		float ta = (lo[axis] - origin[axis]) / delta[axis];
+		float tb = (hi[axis] - origin[axis]) / delta[axis];
+		t0 = std::max(t0, std::min(ta, tb));
+		t1 = std::min(t1, std::max(ta, tb));
+	}
+	return t0 <= t1;
+}
+
+bool Door::hit(const float x, const float y, const float dir_x, const float dir_y, float& t, float& along) const {
+	const float across = vertical ? dir_x : dir_y;
+	if (across == 0) return false; // parallel to the panel
+	t = ((vertical ? i : j) + .5f - (vertical ? x : y)) / across;
+	along = (vertical ? y + t * dir_y - j : x + t * dir_x - i) - open;
+	return t >= 0 && along >= 0 && along < 1 - open;
+}
+
+Map::Map() : w(16), h(16), floor_texture(5), ceiling_texture(1), fog_distance(12), fog_color(pack_color(0, 0, 0)), version(0), cells(map, map + sizeof(map) - 1), changes(), doors(), door_at(w * h, -1), door_version(0), door_changes() {
 	assert(sizeof(map) == w * h + 1); // +1 for the null terminated string
 }
 
 int Map::get(const size_t i, const size_t j) {
-	assert(i < w && j < h && sizeof(map) == w * h + 1);
-	return map[i + j * w] - '0';
+	assert(i < w && j < h && cells.size() == w * h);
+	return cells[i + j * w] - '0';
 }
 
 bool Map::is_empty(const size_t i, const size_t j) {
-	assert(i < w && j < h && sizeof(map) == w * h + 1);
-	return map[i + j * w] == ' ';
+	assert(i < w && j < h && cells.size() == w * h);
+	return cells[i + j * w] == ' ';
+}
+
+bool Map::is_clear(const size_t i, const size_t j) {
+	return is_empty(i, j) || door_at[i + j * w] >= 0;
+}
+
+int Map::door(const size_t i, const size_t j) const {
+	assert(i < w && j < h);
+	return door_at[i + j * w];
+}
+
+// bump the counter and log region as its last change, forgetting the oldest one when the log is full
+static void log_change(uint64_t& counter, std::vector<MapChange>& log, const MapRegion& region) {
+	counter++;
+	if (log.size() == max_changes) log.erase(log.begin());
+	log.push_back(MapChange{counter, region});
+}
+
+void Map::set(const size_t i, const size_t j, const int texture) {
+	edit(std::vector<MapEdit>(1, MapEdit{i, j, texture}));
+}
+
+void Map::edit(const std::vector<MapEdit>& edits) {
+	MapRegion region;
+	bool removed = false;
+	for (size_t e = 0; e < edits.size(); e++) {
+		const MapEdit& edit = edits[e];
+		assert(edit.i < w && edit.j < h && edit.texture >= -1 && edit.texture < 10);
+		const char cell = edit.texture < 0 ? ' ' : '0' + edit.texture;
+		const size_t index = edit.i + edit.j * w;
+		if (cells[index] == cell && door_at[index] < 0) continue;
+		if (door_at[index] >= 0) {
+			doors.erase(doors.begin() + door_at[index]);
+			door_at[index] = -1;
+			removed = true;
+		}
+		cells[index] = cell;
+		region.add(MapRegion(edit.i, edit.j, edit.i + 1, edit.j + 1));
+	}
+	if (removed) { // the doors past the removed ones moved down
+		std::fill(door_at.begin(), door_at.end(), -1);
+		for (size_t d = 0; d < doors.size(); d++) {
+			door_at[doors[d].i + doors[d].j * w] = d;
+		}
+	}
+	if (region.empty()) return; // nothing changed, the derived structures stay valid
+	log_change(version, changes, region);
+}
+
+size_t Map::add_door(const size_t i, const size_t j, const int texture, const bool vertical, const float open, const float speed) {
+	assert(i < w && j < h && texture >= 0 && texture < 10 && open >= 0 && open <= 1);
+	const size_t index = i + j * w;
+	if (door_at[index] < 0) {
+		door_at[index] = doors.size();
+		doors.push_back(Door());
+	}
+	doors[door_at[index]] = Door{i, j, vertical, open, open, speed};
+	cells[index] = '0' + texture;
+	log_change(version, changes, MapRegion(i, j, i + 1, j + 1)); // no longer empty nor a wall, the static structures see through it
+	return door_at[index];
+}
+
+void Map::move_doors(const float dt) {
+	MapRegion region;
+	for (size_t d = 0; d < doors.size(); d++) {
+		Door& door = doors[d];
+		if (door.open == door.target) continue;
+		const float step = door.speed * dt;
+		door.open = door.open < door.target ? std::min(door.open + step, door.target) : std::max(door.open - step, door.target);
+		region.add(MapRegion(door.i, door.j, door.i + 1, door.j + 1));
+	}
+	if (!region.empty()) log_change(door_version, door_changes, region);
+}
+
+// union of the regions of the changes of log after counter value since
+static bool changes_in(const std::vector<MapChange>& log, const uint64_t counter, const uint64_t since, const size_t w, const size_t h, MapRegion& region) {
+	assert(since <= counter);
+	region = MapRegion();
+	if (since == counter) return false;
+	if (log.empty() || log.front().version > since + 1) { // the log no longer goes back that far
+		region = MapRegion(0, 0, w, h);
+		return true;
+	}
+	for (size_t c = 0; c < log.size(); c++) {
+		if (log[c].version > since) region.add(log[c].region);
+	}
+	return true;
+}
+
+bool Map::changes_since(const uint64_t since, MapRegion& region) const {
+	return changes_in(changes, version, since, w, h, region);
+}
+
+bool Map::doors_moved_since(const uint64_t since, MapRegion& region) const {
+	return changes_in(door_changes, door_version, since, w, h, region);
 }
@@ -2,12 +2,72 @@
 #define MAP_H
 
 #include <cstdlib>
+#include <cstdint>
+#include <vector>
 
+// Rectangle of cells [i0, i1) x [j0, j1), empty when i0 >= i1
+typedef struct MapRegion {
+	size_t i0, j0, i1, j1;
+
+	MapRegion();
+	MapRegion(const size_t i0, const size_t j0, const size_t i1, const size_t j1);
+	bool empty() const;
+	bool contains(const size_t i, const size_t j) const;
+	void add(const MapRegion& region);	// grow to the bounding rectangle of both
+	bool crosses(const float x0, const float y0, const float x1, const float y1) const; // the segment (x0, y0) - (x1, y1) touches the rectangle
+} MapRegion;
+
+typedef struct MapEdit {
+	size_t i, j;
+	int texture;	// wall texture id, -1 for an empty cell
+} MapEdit;
+
+typedef struct MapChange {
+	uint64_t version;	// Map::version after the change
+	MapRegion region;	// bounding rectangle of the cells it changed
+} MapChange;
+
+// Thin wall across the middle of its cell, sliding along itself into the next cell as it opens
+typedef struct Door {
+	size_t i, j;
+	bool vertical;	// the panel lies on x = i + .5 and slides toward +y, or on y = j + .5 and slides toward +x
+	float open;	// fraction of the panel slid away, 0 closed, 1 open
+	float target;	// move_doors() moves open toward it
+	float speed;	// fraction per second
+
+	// where the ray from (x, y) along (dir_x, dir_y) meets the closed part of the panel (t >= 0, in
+	// multiples of dir), and the position of that point along the panel from its sliding edge, in [0, 1 - open)
+	bool hit(const float x, const float y, const float dir_x, const float dir_y, float& t, float& along) const;
+} Door;
+
+// Every set() or edit() that changes cells bumps version and logs the rectangle it touched. Structures
+// derived from the cells (Lightmap, PVS, LosGrid, the render caches) remember the version they were built
+// for and ask changes_since() for the region to recompute, instead of being rebuilt from scratch.
+// Doors are cells too (get() is their texture, is_empty() is false), but the static structures see through
+// them (is_clear()) so that moving them only bumps door_version, which the ray casts and LosGrid follow.
 typedef struct Map {
 	size_t w, h;
+	int floor_texture, ceiling_texture; // wall texture ids used for the floor and the ceiling, -1 to leave them as the clear color
+	float fog_distance;	// distance at which shaded textures reach their last light level, 0 disables distance shading
+	uint32_t fog_color;	// color shaded textures fade to, see Texture::shade
+	uint64_t version;	// number of edits that changed cells so far
+	std::vector<char> cells;	// w * h, '0' + texture id for walls, ' ' for empty cells
+	std::vector<MapChange> changes;	// the last edits, oldest first, older ones are forgotten
+	std::vector<Door> doors;
+	std::vector<int32_t> door_at;	// w * h, index in doors or -1
+	uint64_t door_version;		// number of move_doors() calls that moved some door
+	std::vector<MapChange> door_changes; // the last door moves, as changes
 	Map();
 	int get(const size_t i, const size_t j);
 	bool is_empty(const size_t i, const size_t j);
+	bool is_clear(const size_t i, const size_t j);			// empty or a door
+	int door(const size_t i, const size_t j) const;			// index in doors, -1 if the cell is no door
+	void set(const size_t i, const size_t j, const int texture);	// wall texture id, -1 for an empty cell
+	void edit(const std::vector<MapEdit>& edits);			// apply all edits as a single version, editing a door removes it
+	size_t add_door(const size_t i, const size_t j, const int texture, const bool vertical, const float open = 0, const float speed = 1); // returns the door index
+	void move_doors(const float dt);				// move every door toward its target, as a single door_version
+	bool changes_since(const uint64_t since, MapRegion& region) const; // cells changed after version since, false if none
+	bool doors_moved_since(const uint64_t since, MapRegion& region) const; // cells of the doors moved after door_version since
 } Map;
 
 #endif
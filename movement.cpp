@@ -0,0 +1,104 @@
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "movement.h"
+#include "utils.h"
+#include "profile.h"
+
+Movers::Movers(const float radius, const float restitution) : x(), y(), vx(), vy(), radius(radius), restitution(restitution) {
+	assert(radius >= 0 && radius < .5);
+}
+
+size_t Movers::size() const {
+	return x.size();
+}
+
+void Movers::add(const float x, const float y, const float vx, const float vy) {
+	this->x.push_back(x);
+	this->y.push_back(y);
+	this->vx.push_back(vx);
+	this->vy.push_back(vy);
+}
+
+// solid[cell * stride + first * cross] | solid[cell * stride + last * cross], cells outside the along x across grid count as walls
+static inline uint8_t blocked_at(const uint8_t* solid, const int32_t stride, const int32_t cross, const int32_t along, const int32_t across, const int32_t cell, const int32_t first, const int32_t last) {
+	const uint8_t outside = cell < 0 || cell >= along || first < 0 || last >= across;
+	const auto clamp = [](const int32_t i, const int32_t n) { return std::min(std::max(i, 0), n - 1); }; // keeps the reads in the grid
+	const int32_t c = clamp(cell, along);
+	return outside | solid[c * stride + clamp(first, across) * cross] | solid[c * stride + clamp(last, across) * cross];
+}
+
+// Move the positions p[0, n) by v * dt, stopping at the walls crossed by their leading edge. The other
+// coordinate q spans the cells [q - r, q + r]; stride is 1 to move along x and the grid width along y,
+// along and across are the grid sizes in the moving and the other direction, the cells past them are
+// walls. A blocked mover is put just before the wall face and its velocity reflected by restitution. The
+// direction and the outcome are applied as factors rather than by branching, as either is a coin toss.
+#ifdef __SSE2__
+static inline __m128i floor_epi32(const __m128 x) { // truncate, then step down where that rounded up
+	const __m128i t = _mm_cvttps_epi32(x);
+	return _mm_add_epi32(t, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(t), x)));
+}
+#endif
+
+static void move_axis(const uint8_t* solid, const int32_t stride, const int32_t cross, const int32_t along, const int32_t across, float* p, const float* q, float* v, const size_t n, const float dt, const float r, const float restitution) {
+	const float gap = 1e-3f; // left between a stopped mover and the wall, so it does not touch the cells past it
+	size_t k = 0;
+#ifdef __SSE2__
+	const __m128 sign_bit = _mm_set1_ps(-0.f), one = _mm_set1_ps(1), half = _mm_set1_ps(.5f), radius = _mm_set1_ps(r);
+	const __m128 dt4 = _mm_set1_ps(dt), reach = _mm_set1_ps(.5f + r + gap), bounce = _mm_set1_ps(1 + restitution);
+	for (; k + 4 <= n; k += 4) { // the same steps as the loop below, 4 movers at a time
+		const __m128 d = _mm_mul_ps(_mm_loadu_ps(&v[k]), dt4);
+		const __m128 sign = _mm_or_ps(_mm_and_ps(d, sign_bit), one);
+		const __m128 moved = _mm_add_ps(_mm_loadu_ps(&p[k]), d);
+		const __m128 cross_p = _mm_loadu_ps(&q[k]);
+		const __m128i cell = floor_epi32(_mm_add_ps(moved, _mm_mul_ps(sign, radius)));
+		const __m128i first = floor_epi32(_mm_sub_ps(cross_p, radius)), last = floor_epi32(_mm_add_ps(cross_p, radius));
+		int32_t cells[3][4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(cells[0]), cell);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(cells[1]), first);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(cells[2]), last);
+		float hits[4];
+		for (size_t l = 0; l < 4; l++) {
+			assert(std::abs(v[k + l] * dt) < 1);
+			hits[l] = blocked_at(solid, stride, cross, along, across, cells[0][l], cells[1][l], cells[2][l]);
+		}
+		const __m128 blocked = _mm_loadu_ps(hits);
+		const __m128 stop = _mm_sub_ps(_mm_add_ps(_mm_cvtepi32_ps(cell), half), _mm_mul_ps(sign, reach));
+		_mm_storeu_ps(&p[k], _mm_add_ps(moved, _mm_mul_ps(blocked, _mm_sub_ps(stop, moved))));
+		_mm_storeu_ps(&v[k], _mm_mul_ps(_mm_loadu_ps(&v[k]), _mm_sub_ps(one, _mm_mul_ps(blocked, bounce))));
+	}
+#endif
+	for (; k < n; k++) {
+		const float d = v[k] * dt;
+		assert(std::abs(d) < 1);
+		const float sign = std::copysign(1.f, d);
+		const float moved = p[k] + d;
+		const int32_t cell = static_cast<int32_t>(std::floor(moved + sign * r)); // cell of the leading edge
+		const int32_t first = static_cast<int32_t>(std::floor(q[k] - r)), last = static_cast<int32_t>(std::floor(q[k] + r));
+		const float blocked = blocked_at(solid, stride, cross, along, across, cell, first, last);
+		const float stop = cell + .5f - sign * (.5f + r + gap);
+		p[k] = moved + blocked * (stop - moved);
+		v[k] *= 1 - blocked * (1 + restitution);
+	}
+}
+
+void move_batch(const LosGrid& grid, Movers& movers, const float dt, const size_t nthreads) {
+	const int32_t w = grid.w, h = grid.h;
+	parallel_chunks(movers.size(), 4096, nthreads, [&](size_t, const size_t begin, const size_t end) {
+		PROFILE_SCOPE("move_chunk");
+		move_axis(grid.solid.data(), 1, w, w, h, &movers.x[begin], &movers.y[begin], &movers.vx[begin], end - begin, dt, movers.radius, movers.restitution);
+		move_axis(grid.solid.data(), w, 1, h, w, &movers.y[begin], &movers.x[begin], &movers.vy[begin], end - begin, dt, movers.radius, movers.restitution);
+	});
+}
+
+void copy_positions(const Movers& movers, SpriteSet& sprites) {
+	assert(sprites.size() <= movers.size());
+	std::copy(movers.x.begin(), movers.x.begin() + sprites.size(), sprites.x.begin());
+	std::copy(movers.y.begin(), movers.y.begin() + sprites.size(), sprites.y.begin());
+}
@@ -0,0 +1,29 @@
+#ifndef MOVEMENT_H
+#define MOVEMENT_H
+
+#include <cstdlib>
+#include <vector>
+
+#include "los.h"
+#include "sprite.h"
+
+// Entities moving over the map, stored as separate arrays (structure of arrays) so that a tick is one
+// branch free pass over contiguous floats. Each is a square of side 2 * radius colliding with the walls.
+typedef struct Movers {
+	std::vector<float> x, y;	// centers
+	std::vector<float> vx, vy;	// velocities, in cells per second
+	float radius;			// shared by all movers, below .5
+	float restitution;		// share of the velocity reflected by a wall, 0 slides along it
+
+	Movers(const float radius = .2, const float restitution = 0);
+	size_t size() const;
+	void add(const float x, const float y, const float vx, const float vy);
+} Movers;
+
+// Move every mover by its velocity over dt, along x then along y (less than a cell each), stopping
+// an axis at the wall the mover would enter and keeping the other one so that it slides along walls.
+// Chunks of movers are spread over nthreads with parallel_chunks().
+void move_batch(const LosGrid& grid, Movers& movers, const float dt, const size_t nthreads = 0);
+void copy_positions(const Movers& movers, SpriteSet& sprites); // sprite i follows mover i
+
+#endif
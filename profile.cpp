@@ -0,0 +1,104 @@
+#ifdef PROFILE
+
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <new>
+
+#include "profile.h"
+
+typedef struct TraceEvent {
+	const char* name;
+	uint64_t start, duration;	// nanoseconds, duration is unused for counter events
+	bool counters;			// counter event carrying the frame counters
+	FrameCounters values;
+} TraceEvent;
+
+typedef struct ThreadTrace {
+	size_t tid;
+	std::vector<TraceEvent> events;
+} ThreadTrace;
+
+static const size_t max_events = 1 << 20; // per thread, later events are dropped
+
+thread_local FrameCounters profile_thread_counters = FrameCounters();
+
+static std::mutex traces_mutex;
+static std::vector<std::unique_ptr<ThreadTrace> > traces; // owned here so that they outlive the worker threads
+
+static uint64_t now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static ThreadTrace& thread_trace() {
+	thread_local ThreadTrace* trace = nullptr;
+	if (!trace) {
+		std::lock_guard<std::mutex> lock(traces_mutex);
+		traces.push_back(std::unique_ptr<ThreadTrace>(new ThreadTrace{traces.size(), std::vector<TraceEvent>()}));
+		trace = traces.back().get();
+	}
+	return *trace;
+}
+
+static void record(const TraceEvent& event) {
+	ThreadTrace& trace = thread_trace();
+	if (trace.events.size() < max_events) trace.events.push_back(event);
+}
+
+ProfileScope::ProfileScope(const char* name) : name(name), start(now()) {
+}
+
+ProfileScope::~ProfileScope() {
+	record(TraceEvent{name, start, now() - start, false, FrameCounters()});
+}
+
+ProfileFrame::ProfileFrame() : scope("frame") {
+	profile_thread_counters = FrameCounters();
+}
+
+ProfileFrame::~ProfileFrame() {
+	record(TraceEvent{"counters", now(), 0, true, profile_thread_counters});
+}
+
+void profile_dump_trace(const std::string filename) {
+	std::lock_guard<std::mutex> lock(traces_mutex);
+	std::ofstream ofs(filename);
+	ofs << std::fixed << std::setprecision(3); // microseconds
+	ofs << "{\"traceEvents\":[";
+	bool first = true;
+	for (size_t t = 0; t < traces.size(); t++) {
+		for (size_t i = 0; i < traces[t]->events.size(); i++) {
+			const TraceEvent& e = traces[t]->events[i];
+			ofs << (first ? "\n" : ",\n") << "{\"name\":\"" << e.name << "\",\"pid\":1,\"tid\":" << traces[t]->tid << ",\"ts\":" << e.start / 1000.;
+			if (e.counters) {
+				const FrameCounters& c = e.values;
+				ofs << ",\"ph\":\"C\",\"args\":{\"rays\":" << c.rays << ",\"cells\":" << c.cells << ",\"texels\":" << c.texels << ",\"pixels\":" << c.pixels
+				    << ",\"sprites_drawn\":" << c.sprites_drawn << ",\"sprites_culled\":" << c.sprites_culled << ",\"allocations\":" << c.allocations << "}}";
+			} else {
+				ofs << ",\"ph\":\"X\",\"dur\":" << e.duration / 1000. << "}";
+			}
+			first = false;
+		}
+	}
+	ofs << "\n]}\n";
+	ofs.close();
+}
+
+// count every heap allocation of the current thread
+void* operator new(size_t size) {
+	profile_thread_counters.allocations++;
+	void* p = malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+// Hot path instrumentation, only compiled in with -DPROFILE (make profile): the PROFILE_* macros
+// expand to nothing in the regular build.
+typedef struct FrameCounters {
+	uint64_t rays;			// rays cast
+	uint64_t cells;			// map cells visited by the rays
+	uint64_t texels;		// texels sampled
+	uint64_t pixels;		// pixels written
+	uint64_t sprites_drawn;		// sprites with at least one pixel on screen
+	uint64_t sprites_culled;	// sprites entirely off screen
+	uint64_t allocations;		// operator new calls
+} FrameCounters;
+
+#ifdef PROFILE
+
+extern thread_local FrameCounters profile_thread_counters; // counters of the current frame of this thread
+
+// times its own lifetime as a complete event of the trace
+struct ProfileScope {
+	const char* name;
+	uint64_t start;
+	ProfileScope(const char* name);
+	~ProfileScope();
+};
+
+// a frame resets the counters of its thread when it begins and records them as a counter event when it ends
+struct ProfileFrame {
+	ProfileScope scope;
+	ProfileFrame();
+	~ProfileFrame();
+};
+
+void profile_dump_trace(const std::string filename); // Chrome / Perfetto trace JSON of every event recorded so far
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_FRAME() ProfileFrame PROFILE_CONCAT(profile_frame_, __LINE__)
+#define PROFILE_COUNT(counter, n) (profile_thread_counters.counter += (n))
+#define PROFILE_DUMP(filename) profile_dump_trace(filename)
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+#define PROFILE_COUNT(counter, n) ((void)0)
+#define PROFILE_DUMP(filename) ((void)0)
+
+#endif
+
+#endif
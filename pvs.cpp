@@ -0,0 +1,244 @@
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <limits>
+#include <algorithm>
+
+#include "pvs.h"
+
+PVS::PVS() : w(0), h(0), map_hash(0), bits(), words_per_row(0), samples(4), rays(720), traced(), version(0) {
+}
+
+uint64_t pvs_map_hash(Map& map) {
+	uint64_t hash = 14695981039346656037ull; // FNV-1a
+	const auto mix = [&hash](const uint64_t value) {
+		hash = (hash ^ value) * 1099511628211ull;
+	};
+	mix(map.w);
+	mix(map.h);
+	for (size_t j = 0; j < map.h; j++) {
+		for (size_t i = 0; i < map.w; i++) {
+			mix(map.is_clear(i, j));
+		}
+	}
+	return hash;
+}
+
+// mark every cell the ray from (x, y) along dir crosses, up to and including the first wall
+static void trace(Map& map, const float x, const float y, const float dir_x, const float dir_y, uint64_t* row) {
+	int i = static_cast<int>(x);
+	int j = static_cast<int>(y);
+	const float inf = std::numeric_limits<float>::infinity();
+	const float delta_x = dir_x == 0 ? inf : std::abs(1 / dir_x);
+	const float delta_y = dir_y == 0 ? inf : std::abs(1 / dir_y);
+	const int step_i = dir_x < 0 ? -1 : 1;
+	const int step_j = dir_y < 0 ? -1 : 1;
+	float side_x = dir_x == 0 ? inf : (dir_x < 0 ? x - i : i + 1 - x) * delta_x;
+	float side_y = dir_y == 0 ? inf : (dir_y < 0 ? y - j : j + 1 - y) * delta_y;
+	for (;;) {
+		if (side_x < side_y) {
+			side_x += delta_x;
+			i += step_i;
+		} else {
+			side_y += delta_y;
+			j += step_j;
+		}
+		if (i < 0 || j < 0 || i >= static_cast<int>(map.w) || j >= static_cast<int>(map.h)) return;
+		const size_t cell = i + j * map.w;
+		row[cell / 64] |= uint64_t(1) << (cell % 64);
+		if (!map.is_clear(i, j)) return;
+	}
+}
+
+// trace the row of the cell from into pvs.traced, empty for a wall
+static void trace_cell(Map& map, PVS& pvs, const size_t from) {
+	uint64_t* row = &pvs.traced[from * pvs.words_per_row];
+	std::fill(row, row + pvs.words_per_row, 0);
+	const size_t i = from % pvs.w, j = from / pvs.w;
+	if (!map.is_clear(i, j)) return;
+	row[from / 64] |= uint64_t(1) << (from % 64);
+	for (size_t sy = 0; sy < pvs.samples; sy++) {
+		for (size_t sx = 0; sx < pvs.samples; sx++) {
+			const float x = i + (sx + .5f) / pvs.samples, y = j + (sy + .5f) / pvs.samples;
+			for (size_t r = 0; r < pvs.rays; r++) {
+				const float a = 2 * M_PI * (r + .5f) / pvs.rays;
+				trace(map, x, y, cos(a), sin(a), row);
+			}
+		}
+	}
+}
+
+// bits of the pair (a, b) from the traced ones: empty cells see each other both ways, sampling may have caught only one
+static void link(Map& map, PVS& pvs, const size_t a, const size_t b) {
+	const size_t words = pvs.words_per_row;
+	bool ab = pvs.traced[a * words + b / 64] >> (b % 64) & 1;
+	bool ba = pvs.traced[b * words + a / 64] >> (a % 64) & 1;
+	if (map.is_clear(a % pvs.w, a / pvs.w) && map.is_clear(b % pvs.w, b / pvs.w)) ab = ba = ab || ba;
+	const uint64_t mask_b = uint64_t(1) << (b % 64), mask_a = uint64_t(1) << (a % 64);
+	pvs.bits[a * words + b / 64] = ab ? pvs.bits[a * words + b / 64] | mask_b : pvs.bits[a * words + b / 64] & ~mask_b;
+	pvs.bits[b * words + a / 64] = ba ? pvs.bits[b * words + a / 64] | mask_a : pvs.bits[b * words + a / 64] & ~mask_a;
+}
+
+void PVS::build(Map& map, const size_t samples, const size_t rays) {
+	w = map.w;
+	h = map.h;
+	map_hash = pvs_map_hash(map);
+	version = map.version;
+	this->samples = samples;
+	this->rays = rays;
+	words_per_row = (w * h + 63) / 64;
+	traced.assign(w * h * words_per_row, 0);
+	for (size_t from = 0; from < w * h; from++) {
+		trace_cell(map, *this, from);
+	}
+	bits = traced;
+	for (size_t a = 0; a < w * h; a++) {
+		for (size_t b = a + 1; b < w * h; b++) {
+			link(map, *this, a, b);
+		}
+	}
+}
+
+void PVS::update(Map& map) {
+	MapRegion region;
+	if (!map.changes_since(version, region)) return;
+	if (traced.size() != w * h * words_per_row || map.w != w || map.h != h) {
+		build(map, samples, rays);
+		return;
+	}
+	std::vector<size_t> retrace; // cells whose traced row reached the region, and the region itself
+	for (size_t a = 0; a < w * h; a++) {
+		bool dirty = region.contains(a % w, a / w);
+		for (size_t j = region.j0; j < region.j1 && !dirty; j++) {
+			for (size_t i = region.i0; i < region.i1 && !dirty; i++) {
+				const size_t b = i + j * w;
+				dirty = traced[a * words_per_row + b / 64] >> (b % 64) & 1;
+			}
+		}
+		if (dirty) retrace.push_back(a);
+	}
+	for (size_t r = 0; r < retrace.size(); r++) {
+		trace_cell(map, *this, retrace[r]);
+	}
+	for (size_t r = 0; r < retrace.size(); r++) {
+		for (size_t b = 0; b < w * h; b++) {
+			link(map, *this, retrace[r], b);
+		}
+	}
+	map_hash = pvs_map_hash(map);
+	version = map.version;
+}
+
+bool PVS::visible(const size_t from_i, const size_t from_j, const size_t i, const size_t j) const {
+	assert(from_i < w && from_j < h && i < w && j < h);
+	const size_t cell = i + j * w;
+	return bits[(from_i + from_j * w) * words_per_row + cell / 64] >> (cell % 64) & 1;
+}
+
+bool PVS::visible_from(const float x, const float y, const size_t i, const size_t j) const {
+	if (x < 0 || y < 0 || x >= w || y >= h || i >= w || j >= h) return true;
+	const size_t from = static_cast<size_t>(x) + static_cast<size_t>(y) * w;
+	if (!(bits[from * words_per_row + from / 64] >> (from % 64) & 1)) return true; // not an empty cell, nothing was built for it
+	return visible(x, y, i, j);
+}
+
+size_t PVS::count(const size_t i, const size_t j) const {
+	size_t n = 0;
+	for (size_t k = 0; k < words_per_row; k++) {
+		n += __builtin_popcountll(bits[(i + j * w) * words_per_row + k]);
+	}
+	return n;
+}
+
+static void put_varint(std::vector<uint8_t>& out, size_t value) {
+	while (value >= 128) {
+		out.push_back((value & 127) | 128);
+		value >>= 7;
+	}
+	out.push_back(value);
+}
+
+static bool get_varint(const std::vector<uint8_t>& in, size_t& pos, size_t& value) {
+	value = 0;
+	for (int shift = 0; pos < in.size() && shift < 64; shift += 7) {
+		const uint8_t byte = in[pos++];
+		value |= static_cast<size_t>(byte & 127) << shift;
+		if (!(byte & 128)) return true;
+	}
+	return false;
+}
+
+static void put_le(std::vector<uint8_t>& out, const uint64_t value, const size_t bytes) {
+	for (size_t i = 0; i < bytes; i++) {
+		out.push_back(value >> (8 * i) & 255);
+	}
+}
+
+static uint64_t get_le(const std::vector<uint8_t>& in, const size_t pos, const size_t bytes) {
+	uint64_t value = 0;
+	for (size_t i = 0; i < bytes; i++) {
+		value |= static_cast<uint64_t>(in[pos + i]) << (8 * i);
+	}
+	return value;
+}
+
+bool PVS::save(const std::string filename) const {
+	std::vector<uint8_t> out(8);
+	memcpy(out.data(), "TRCPVS01", 8);
+	put_le(out, w, 4);
+	put_le(out, h, 4);
+	put_le(out, map_hash, 8);
+	const size_t n = w * h;
+	for (size_t a = 0; a < n; a++) {
+		bool bit = false;
+		size_t run = 0;
+		for (size_t b = 0; b < n; b++) {
+			if ((bits[a * words_per_row + b / 64] >> (b % 64) & 1) == bit) {
+				run++;
+				continue;
+			}
+			put_varint(out, run);
+			bit = !bit;
+			run = 1;
+		}
+		put_varint(out, run); // the runs of a row always add up to n
+	}
+	std::ofstream ofs(filename, std::ios::binary);
+	ofs.write(reinterpret_cast<const char*>(out.data()), out.size());
+	return static_cast<bool>(ofs);
+}
+
+bool PVS::load(const std::string filename, Map& map) {
+	std::ifstream ifs(filename, std::ios::binary);
+	if (!ifs) return false;
+	const std::vector<uint8_t> in((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	if (in.size() < 24 || memcmp(in.data(), "TRCPVS01", 8)) return false;
+	if (get_le(in, 8, 4) != map.w || get_le(in, 12, 4) != map.h || get_le(in, 16, 8) != pvs_map_hash(map)) return false;
+	const size_t n = map.w * map.h;
+	const size_t words = (n + 63) / 64;
+	std::vector<uint64_t> loaded(n * words, 0);
+	size_t pos = 24;
+	for (size_t a = 0; a < n; a++) {
+		bool bit = false;
+		for (size_t b = 0; b < n; bit = !bit) {
+			size_t run;
+			if (!get_varint(in, pos, run) || b + run > n) return false;
+			for (size_t k = b; bit && k < b + run; k++) {
+				loaded[a * words + k / 64] |= uint64_t(1) << (k % 64);
+			}
+			b += run;
+		}
+	}
+	w = map.w;
+	h = map.h;
+	map_hash = get_le(in, 16, 8);
+	words_per_row = words;
+	bits.swap(loaded);
+	traced.clear(); // the first update() builds again
+	version = map.version;
+	return true;
+}
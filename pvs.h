@@ -0,0 +1,40 @@
+#ifndef PVS_H
+#define PVS_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "map.h"
+
+// Potentially visible set: for every empty cell, the cells (walls and empty ones) that some ray
+// from a sample point of it reaches. Doors count as empty (Map::is_clear) whatever their state.
+// Built offline by ray sampling and made symmetric, so a cell missing from the set of another is
+// not seen from it (up to the sampling density).
+// File: "TRCPVS01", uint32 w, h, uint64 hash of the map cells, then per cell the lengths of the
+// alternating runs of 0 and 1 bits of its row (w * h bits, first run of 0s) as LEB128 varints.
+typedef struct PVS {
+	size_t w, h;
+	uint64_t map_hash;		// of the cells the set was built for, see pvs_map_hash()
+	std::vector<uint64_t> bits;	// w * h rows of words_per_row words, bit b of row a: cell b is visible from cell a
+	size_t words_per_row;
+	size_t samples, rays;		// sampling of the last build, reused by update()
+	std::vector<uint64_t> traced;	// bits as the rays found them, before they were made symmetric, empty after load()
+	uint64_t version;		// Map::version the set was built for
+
+	PVS();
+	void build(Map& map, const size_t samples = 4, const size_t rays = 720); // samples x samples points per empty cell, rays directions each
+	// Trace again only the cells whose rays reached a changed cell (no other ray can change) and the
+	// changed cells themselves, then make the pairs they are part of symmetric. Builds it all after load().
+	void update(Map& map);
+	bool visible(const size_t from_i, const size_t from_j, const size_t i, const size_t j) const;
+	bool visible_from(const float x, const float y, const size_t i, const size_t j) const; // from the cell of (x, y), true outside of the map or from a wall
+	size_t count(const size_t i, const size_t j) const; // number of cells visible from (i, j)
+	bool save(const std::string filename) const;
+	bool load(const std::string filename, Map& map); // false if missing, corrupt or built for other cells
+} PVS;
+
+uint64_t pvs_map_hash(Map& map);
+
+#endif
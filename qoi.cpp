@@ -0,0 +1,218 @@
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+#include "qoi.h"
+#include "utils.h"
+
+enum {
+	QOI_OP_INDEX = 0x00,	// 00xxxxxx
+	QOI_OP_DIFF  = 0x40,	// 01xxxxxx
+	QOI_OP_LUMA  = 0x80,	// 10xxxxxx
+	QOI_OP_RUN   = 0xc0,	// 11xxxxxx
+	QOI_OP_RGB   = 0xfe,
+	QOI_OP_RGBA  = 0xff
+};
+
+static const uint8_t qoi_padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+static inline size_t qoi_hash(const uint32_t color) { // packed as pack_color: r, g, b, a from the low byte up
+	return ((color & 255) * 3 + (color >> 8 & 255) * 5 + (color >> 16 & 255) * 7 + (color >> 24) * 11) % 64;
+}
+
+static void put_be(std::vector<uint8_t>& out, const uint32_t value) {
+	for (int i = 3; i >= 0; i--) {
+		out.push_back(value >> (8 * i));
+	}
+}
+
+// pixels [begin, end) with alpha forced to 255, returns the end of the written bytes
+static uint8_t* encode_stripe(const uint32_t* begin, const uint32_t* end, uint8_t* out) {
+	uint32_t index[64];
+	uint64_t written = 0; // bit i: index[i] was written by this stripe, so the decoder holds the same color there
+	uint32_t prev = 0;
+	size_t run = 0;
+	for (const uint32_t* p = begin; p < end; p++) {
+		const uint32_t px = *p | 0xff000000u;
+		if (px == prev && p != begin) {
+			if (++run == 62) {
+				*out++ = QOI_OP_RUN | (run - 1);
+				run = 0;
+			}
+			continue;
+		}
+		if (run) {
+			*out++ = QOI_OP_RUN | (run - 1);
+			run = 0;
+		}
+		const size_t h = qoi_hash(px);
+		if ((written >> h & 1) && index[h] == px) {
+			*out++ = QOI_OP_INDEX | h;
+		} else {
+			index[h] = px;
+			written |= uint64_t(1) << h;
+			const int8_t dr = (px & 255) - (prev & 255);
+			const int8_t dg = (px >> 8 & 255) - (prev >> 8 & 255);
+			const int8_t db = (px >> 16 & 255) - (prev >> 16 & 255);
+			const int8_t dr_dg = dr - dg, db_dg = db - dg;
+			if (p == begin) { // the decoder state is unknown at the start of a stripe
+				*out++ = QOI_OP_RGB;
+				*out++ = px & 255;
+				*out++ = px >> 8 & 255;
+				*out++ = px >> 16 & 255;
+			} else if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+				*out++ = QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+			} else if (dr_dg > -9 && dr_dg < 8 && dg > -33 && dg < 32 && db_dg > -9 && db_dg < 8) {
+				*out++ = QOI_OP_LUMA | (dg + 32);
+				*out++ = (dr_dg + 8) << 4 | (db_dg + 8);
+			} else {
+				*out++ = QOI_OP_RGB;
+				*out++ = px & 255;
+				*out++ = px >> 8 & 255;
+				*out++ = px >> 16 & 255;
+			}
+		}
+		prev = px;
+	}
+	if (run) {
+		*out++ = QOI_OP_RUN | (run - 1);
+	}
+	return out;
+}
+
+// encodes the stripes listed in which (all of them if empty) of image into stripes
+static void encode_stripes(const std::vector<uint32_t>& image, const size_t w, const size_t h, const size_t stripe_rows, std::vector<std::vector<uint8_t> >& stripes, const std::vector<size_t>& which, const size_t nthreads) {
+	parallel_chunks(which.empty() ? stripes.size() : which.size(), 1, nthreads, [&](size_t, const size_t k, size_t) {
+		const size_t s = which.empty() ? k : which[k];
+		const size_t begin = s * stripe_rows * w, end = std::min(h, (s + 1) * stripe_rows) * w;
+		stripes[s].resize((end - begin) * 4); // worst case, every pixel QOI_OP_RGB
+		uint8_t* last = encode_stripe(image.data() + begin, image.data() + end, stripes[s].data());
+		stripes[s].resize(last - stripes[s].data());
+	});
+}
+
+static void assemble(const std::vector<std::vector<uint8_t> >& stripes, const size_t w, const size_t h, std::vector<uint8_t>& out) {
+	out.clear();
+	out.insert(out.end(), {'q', 'o', 'i', 'f'});
+	put_be(out, w);
+	put_be(out, h);
+	out.push_back(3); // RGB
+	out.push_back(0); // sRGB
+	for (size_t s = 0; s < stripes.size(); s++) {
+		out.insert(out.end(), stripes[s].begin(), stripes[s].end());
+	}
+	out.insert(out.end(), qoi_padding, qoi_padding + 8);
+}
+
+void encode_qoi(const std::vector<uint32_t>& image, const size_t w, const size_t h, std::vector<uint8_t>& out, size_t nthreads, const size_t stripe_rows) {
+	assert(image.size() == w * h && stripe_rows > 0);
+	std::vector<std::vector<uint8_t> > stripes((h + stripe_rows - 1) / stripe_rows);
+	encode_stripes(image, w, h, stripe_rows, stripes, std::vector<size_t>(), nthreads);
+	assemble(stripes, w, h, out);
+}
+
+QoiEncoder::QoiEncoder(const size_t stripe_rows) : w(0), h(0), stripe_rows(stripe_rows), stripes(), which(), rects() {
+	assert(stripe_rows > 0);
+}
+
+void QoiEncoder::encode(const FrameBuffer& fb, std::vector<uint8_t>& out, const size_t nthreads) {
+	assert(fb.img.size() == fb.w * fb.h);
+	which.clear();
+	if (fb.w != w || fb.h != h) {
+		w = fb.w;
+		h = fb.h;
+		stripes.assign((h + stripe_rows - 1) / stripe_rows, std::vector<uint8_t>());
+		which.resize(stripes.size());
+		for (size_t s = 0; s < stripes.size(); s++) which[s] = s;
+	} else {
+		fb.changed(rects);
+		std::vector<bool> touched(stripes.size(), false);
+		for (size_t r = 0; r < rects.size(); r++) {
+			if (!rects[r].w || !rects[r].h) continue;
+			for (size_t s = rects[r].y / stripe_rows; s <= (rects[r].y + rects[r].h - 1) / stripe_rows; s++) {
+				touched[s] = true;
+			}
+		}
+		for (size_t s = 0; s < stripes.size(); s++) {
+			if (touched[s]) which.push_back(s);
+		}
+	}
+	if (!which.empty()) encode_stripes(fb.img, w, h, stripe_rows, stripes, which, nthreads);
+	assemble(stripes, w, h, out);
+}
+
+bool decode_qoi(const std::vector<uint8_t>& in, std::vector<uint32_t>& image, size_t& w, size_t& h) {
+	if (in.size() < 14 + 8 || memcmp(in.data(), "qoif", 4)) return false;
+	w = static_cast<size_t>(in[4]) << 24 | in[5] << 16 | in[6] << 8 | in[7];
+	h = static_cast<size_t>(in[8]) << 24 | in[9] << 16 | in[10] << 8 | in[11];
+	if (!w || !h || w * h > (in.size() - 22) * 62) return false; // a byte codes at most 62 pixels
+	image.resize(w * h);
+
+	uint32_t index[64] = {0};
+	uint8_t r = 0, g = 0, b = 0, a = 255;
+	size_t pos = 14;
+	const size_t last = in.size() - 8;
+	for (size_t i = 0; i < image.size(); ) {
+		if (pos >= last) return false;
+		const uint8_t op = in[pos++];
+		size_t run = 1;
+		if (op == QOI_OP_RGB || op == QOI_OP_RGBA) {
+			const size_t n = op == QOI_OP_RGB ? 3 : 4;
+			if (pos + n > last) return false;
+			r = in[pos++];
+			g = in[pos++];
+			b = in[pos++];
+			if (n == 4) a = in[pos++];
+		} else if ((op & 0xc0) == QOI_OP_INDEX) {
+			const uint32_t color = index[op];
+			r = color & 255;
+			g = color >> 8 & 255;
+			b = color >> 16 & 255;
+			a = color >> 24;
+		} else if ((op & 0xc0) == QOI_OP_DIFF) {
+			r += ((op >> 4) & 3) - 2;
+			g += ((op >> 2) & 3) - 2;
+			b += (op & 3) - 2;
+		} else if ((op & 0xc0) == QOI_OP_LUMA) {
+			if (pos >= last) return false;
+			const uint8_t next = in[pos++];
+			const int dg = (op & 63) - 32;
+			r += dg - 8 + (next >> 4);
+			g += dg;
+			b += dg - 8 + (next & 15);
+		} else {
+			run = (op & 63) + 1;
+			if (i + run > image.size()) return false;
+		}
+		const uint32_t color = static_cast<uint32_t>(a) << 24 | b << 16 | g << 8 | r;
+		index[qoi_hash(color)] = color;
+		std::fill(image.begin() + i, image.begin() + i + run, color);
+		i += run;
+	}
+	return true;
+}
+
+void drop_qoi_image(const std::string filename, const std::vector<uint32_t>& image, const size_t w, const size_t h) {
+	std::vector<uint8_t> data;
+	encode_qoi(image, w, h, data);
+	std::ofstream ofs(filename, std::ios::binary);
+	ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+void drop_qoi_image(const std::string filename, const FrameBuffer& fb, QoiEncoder& encoder) {
+	std::vector<uint8_t> data;
+	encoder.encode(fb, data);
+	std::ofstream ofs(filename, std::ios::binary);
+	ofs.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+bool load_qoi_image(const std::string filename, std::vector<uint32_t>& image, size_t& w, size_t& h) {
+	std::ifstream ifs(filename, std::ios::binary);
+	if (!ifs) return false;
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	return decode_qoi(data, image, w, h);
+}
@@ -0,0 +1,34 @@
+#ifndef QOI_H
+#define QOI_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "framebuffer.h"
+
+// QOI (https://qoiformat.org) RGB images. The frame is cut into stripes of stripe_rows rows that
+// are encoded independently on up to nthreads threads (see parallel_chunks()): every stripe
+// starts with a full RGB pixel and only uses index entries it wrote itself, so the concatenation
+// is a plain QOI stream any decoder reads. Alpha is dropped, as in the PPM output.
+void encode_qoi(const std::vector<uint32_t>& image, const size_t w, const size_t h, std::vector<uint8_t>& out, size_t nthreads = 0, const size_t stripe_rows = 64);
+bool decode_qoi(const std::vector<uint8_t>& in, std::vector<uint32_t>& image, size_t& w, size_t& h); // any QOI stream, alpha kept
+
+// Keeps the encoded stripes of the last frame and re-encodes only those crossing its dirty
+// regions, the output is the same as encode_qoi of the whole frame.
+typedef struct QoiEncoder {
+	size_t w, h, stripe_rows;
+	std::vector<std::vector<uint8_t> > stripes;
+	std::vector<size_t> which;	// scratch: stripes to encode
+	std::vector<Rect> rects;	// scratch
+
+	QoiEncoder(const size_t stripe_rows = 64);
+	void encode(const FrameBuffer& fb, std::vector<uint8_t>& out, const size_t nthreads = 0); // the first frame and size changes encode everything
+} QoiEncoder;
+
+void drop_qoi_image(const std::string filename, const std::vector<uint32_t>& image, const size_t w, const size_t h);
+void drop_qoi_image(const std::string filename, const FrameBuffer& fb, QoiEncoder& encoder);
+bool load_qoi_image(const std::string filename, std::vector<uint32_t>& image, size_t& w, size_t& h);
+
+#endif
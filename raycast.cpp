@@ -0,0 +1,214 @@
+#include <cmath>
+#include <limits>
+
+#include "raycast.h"
+#include "profile.h"
+
+RayHit cast_ray(Map& map, const float x, const float y, const float dir_x, const float dir_y, const float max_dist, const bool through_doors) {
+	RayHit hit{false, max_dist, x, y, 0, 0, -1, false, 0, false};
+	PROFILE_COUNT(rays, 1);
+	if (x < 0 || y < 0 || x >= map.w || y >= map.h) return hit;
+
+	int i = static_cast<int>(x);
+	int j = static_cast<int>(y);
+	const float inf = std::numeric_limits<float>::infinity();
+	const float delta_x = dir_x == 0 ? inf : std::abs(1 / dir_x); // ray length between two vertical grid lines
+	const float delta_y = dir_y == 0 ? inf : std::abs(1 / dir_y); // ray length between two horizontal grid lines
+	const int step_i = dir_x < 0 ? -1 : 1;
+	const int step_j = dir_y < 0 ? -1 : 1;
+	float side_x = dir_x == 0 ? inf : (dir_x < 0 ? x - i : i + 1 - x) * delta_x; // ray length to the next vertical grid line
+	float side_y = dir_y == 0 ? inf : (dir_y < 0 ? y - j : j + 1 - y) * delta_y; // ray length to the next horizontal grid line
+	const auto door_hit = [&](const int door) { // a door panel across the middle of the cell i, j, or its open part
+		float t, along;
+		if (!map.doors[door].hit(x, y, dir_x, dir_y, t, along) || t > max_dist) return false;
+		hit.hit = true;
+		hit.dist = t;
+		hit.x = x + t * dir_x;
+		hit.y = y + t * dir_y;
+		hit.i = i;
+		hit.j = j;
+		hit.texture_id = map.get(i, j);
+		hit.vertical = map.doors[door].vertical;
+		hit.offset = along - .5f; // the texture slides with the panel
+		hit.door = true;
+		return true;
+	};
+	if (!through_doors && map.door(i, j) >= 0 && door_hit(map.door(i, j))) return hit; // the panel of the cell the ray starts in
+
+	for (;;) {
+		float t;
+		bool vertical;
+		if (side_x < side_y) {
+			t = side_x;
+			side_x += delta_x;
+			i += step_i;
+			vertical = true;
+		} else {
+			t = side_y;
+			side_y += delta_y;
+			j += step_j;
+			vertical = false;
+		}
+		PROFILE_COUNT(cells, 1);
+		if (t > max_dist) return hit;
+		if (i < 0 || j < 0 || i >= static_cast<int>(map.w) || j >= static_cast<int>(map.h)) return hit;
+		if (map.is_empty(i, j)) continue;
+		const int door = map.door(i, j);
+		if (door >= 0) {
+			if (through_doors || !door_hit(door)) continue;
+			return hit;
+		}
+
+		hit.hit = true;
+		hit.dist = t;
+		hit.x = x + t * dir_x;
+		hit.y = y + t * dir_y;
+		hit.i = i;
+		hit.j = j;
+		hit.texture_id = map.get(i, j);
+		hit.vertical = vertical;
+		const float fx = hit.x - floor(hit.x + 0.5); // fx and fy contain (signed) fractional parts of the hit point,
+		const float fy = hit.y - floor(hit.y + 0.5); // one of them is supposed to be very close to 0
+		hit.offset = std::abs(fy) > std::abs(fx) ? fy : fx;
+		return hit;
+	}
+}
+
+RayHit cast_ray_fixed(Map& map, const int32_t x, const int32_t y, const int32_t dir_x, const int32_t dir_y, const int32_t max_dist) {
+	const float one = 1 << FIXED_SHIFT;
+	RayHit hit{false, max_dist / one, x / one, y / one, 0, 0, -1, false, 0, false};
+	PROFILE_COUNT(rays, 1);
+	if (x < 0 || y < 0 || x >= static_cast<int32_t>(map.w << FIXED_SHIFT) || y >= static_cast<int32_t>(map.h << FIXED_SHIFT)) return hit;
+
+	int i = x >> FIXED_SHIFT;
+	int j = y >> FIXED_SHIFT;
+	const int64_t inf = std::numeric_limits<int64_t>::max() / 2; // leaves room for one more delta
+	const int64_t delta_x = dir_x == 0 ? inf : (int64_t(1) << (FIXED_SHIFT + FIXED_DIR_SHIFT)) / std::abs(static_cast<int64_t>(dir_x)); // 16.16 ray length between two vertical grid lines
+	const int64_t delta_y = dir_y == 0 ? inf : (int64_t(1) << (FIXED_SHIFT + FIXED_DIR_SHIFT)) / std::abs(static_cast<int64_t>(dir_y));
+	const int step_i = dir_x < 0 ? -1 : 1;
+	const int step_j = dir_y < 0 ? -1 : 1;
+	int64_t side_x = dir_x == 0 ? inf : (dir_x < 0 ? x - (int64_t(i) << FIXED_SHIFT) : (int64_t(i + 1) << FIXED_SHIFT) - x) * delta_x >> FIXED_SHIFT;
+	int64_t side_y = dir_y == 0 ? inf : (dir_y < 0 ? y - (int64_t(j) << FIXED_SHIFT) : (int64_t(j + 1) << FIXED_SHIFT) - y) * delta_y >> FIXED_SHIFT;
+	const auto door_hit = [&](const int door) { // same as cast_ray(), with the panel position and the open fraction in 16.16
+		const Door& panel = map.doors[door];
+		const int64_t across = panel.vertical ? dir_x : dir_y;
+		if (across == 0) return false;
+		const int64_t plane = (static_cast<int64_t>(panel.vertical ? i : j) << FIXED_SHIFT) + (1 << (FIXED_SHIFT - 1));
+		const int64_t door_t = ((plane - (panel.vertical ? x : y)) << FIXED_DIR_SHIFT) / across;
+		const int32_t door_x = panel.vertical ? plane : x + (door_t * dir_x >> FIXED_DIR_SHIFT);
+		const int32_t door_y = panel.vertical ? y + (door_t * dir_y >> FIXED_DIR_SHIFT) : plane;
+		const int32_t along = (panel.vertical ? door_y - (j << FIXED_SHIFT) : door_x - (i << FIXED_SHIFT)) - to_fixed(panel.open);
+		if (door_t < 0 || door_t > max_dist || along < 0 || along >= (1 << FIXED_SHIFT) - to_fixed(panel.open)) return false;
+		hit.hit = true;
+		hit.dist = door_t / one;
+		hit.x = door_x / one;
+		hit.y = door_y / one;
+		hit.i = i;
+		hit.j = j;
+		hit.texture_id = map.get(i, j);
+		hit.vertical = panel.vertical;
+		hit.offset = (along - (1 << (FIXED_SHIFT - 1))) / one;
+		hit.door = true;
+		return true;
+	};
+	if (map.door(i, j) >= 0 && door_hit(map.door(i, j))) return hit; // the panel of the cell the ray starts in
+
+	for (;;) {
+		int64_t t;
+		bool vertical;
+		if (side_x < side_y) {
+			t = side_x;
+			side_x += delta_x;
+			i += step_i;
+			vertical = true;
+		} else {
+			t = side_y;
+			side_y += delta_y;
+			j += step_j;
+			vertical = false;
+		}
+		PROFILE_COUNT(cells, 1);
+		if (t > max_dist) return hit;
+		if (i < 0 || j < 0 || i >= static_cast<int>(map.w) || j >= static_cast<int>(map.h)) return hit;
+		if (map.is_empty(i, j)) continue;
+		const int door = map.door(i, j);
+		if (door >= 0) {
+			if (!door_hit(door)) continue;
+			return hit;
+		}
+
+		// the point on the crossed grid line is exact, only the coordinate along the face is rounded
+		const int32_t hit_x = vertical ? (dir_x < 0 ? i + 1 : i) << FIXED_SHIFT : x + (t * dir_x >> FIXED_DIR_SHIFT);
+		const int32_t hit_y = vertical ? y + (t * dir_y >> FIXED_DIR_SHIFT) : (dir_y < 0 ? j + 1 : j) << FIXED_SHIFT;
+		const int32_t along = (vertical ? hit_y : hit_x) & ((1 << FIXED_SHIFT) - 1);
+		hit.hit = true;
+		hit.dist = t / one;
+		hit.x = hit_x / one;
+		hit.y = hit_y / one;
+		hit.i = i;
+		hit.j = j;
+		hit.texture_id = map.get(i, j);
+		hit.vertical = vertical;
+		hit.offset = (along < (1 << (FIXED_SHIFT - 1)) ? along : along - (1 << FIXED_SHIFT)) / one;
+		return hit;
+	}
+}
+
+int32_t to_fixed(const float value) {
+	return static_cast<int32_t>(std::lround(value * (1 << FIXED_SHIFT)));
+}
+
+uint32_t to_binary_angle(const float a) {
+	const double turns = a / (2 * M_PI);
+	return static_cast<uint32_t>(static_cast<int64_t>(std::llround((turns - std::floor(turns)) * 4294967296.)));
+}
+
+// cosine and sine of angle in 2.30 by CORDIC, with atan(2^-i) in binary angle units and the gain
+// prod 1 / sqrt(1 + 2^-2i) in 2.30 precomputed here rather than with the math library, so that every build agrees
+static void cordic(const uint32_t angle, int32_t& c, int32_t& s) {
+	static const int64_t atan_table[] = {536870912, 316933406, 167458907, 85004756, 42667331, 21354465, 10679838, 5340245, 2670163, 1335087, 667544, 333772, 166886, 83443, 41722, 20861, 10430, 5215, 2608, 1304, 652, 326, 163, 81, 41, 20, 10, 5, 3, 1, 1};
+	const int64_t gain = 652032874;
+	const uint32_t quadrant = angle >> 30;
+	int64_t z = angle & ((1u << 30) - 1); // [0, 90) degrees, within the convergence range
+	int64_t x = gain, y = 0;
+	for (size_t i = 0; i < sizeof(atan_table) / sizeof(atan_table[0]); i++) {
+		const int64_t dx = y >> i, dy = x >> i;
+		if (z >= 0) {
+			x -= dx;
+			y += dy;
+			z -= atan_table[i];
+		} else {
+			x += dx;
+			y -= dy;
+			z += atan_table[i];
+		}
+	}
+	switch (quadrant) { // rotate by the remaining multiple of 90 degrees
+		case 0: c = x; s = y; break;
+		case 1: c = -y; s = x; break;
+		case 2: c = -x; s = -y; break;
+		default: c = y; s = -x;
+	}
+}
+
+void fixed_sincos(const uint32_t angle, int32_t& c, int32_t& s) {
+	// 4096 steps per turn, linearly interpolated (error below 3e-7), built once with cordic()
+	const int bits = 12;
+	struct SineTable {
+		int32_t sine[(1 << bits) + 1];
+		SineTable() {
+			int32_t unused;
+			for (size_t i = 0; i <= (1 << bits); i++) {
+				cordic(static_cast<uint32_t>(i << (32 - bits)), unused, sine[i]);
+			}
+		}
+	};
+	static const SineTable table;
+	const auto interpolate = [](const uint32_t a) {
+		const uint32_t i = a >> (32 - bits);
+		const int64_t t = (a >> (16 - bits)) & 0xffff; // next 16 bits of the angle
+		return static_cast<int32_t>(table.sine[i] + ((table.sine[i + 1] - table.sine[i]) * t >> 16));
+	};
+	s = interpolate(angle);
+	c = interpolate(angle + (1u << 30));
+}
@@ -0,0 +1,39 @@
+#ifndef RAYCAST_H
+#define RAYCAST_H
+
+#include <cstdlib>
+#include <cstdint>
+
+#include "map.h"
+
+typedef struct RayHit {
+	bool hit;		// false if the ray left the map or exceeded max_dist
+	float dist;		// euclidean distance from the origin to the hit point
+	float x, y;		// hit point in map coordinates
+	size_t i, j;		// map cell that was hit
+	int texture_id;		// Map::get(i, j) of the hit cell
+	bool vertical;		// true if a vertical (x = const) wall face was hit
+	float offset;		// position of the hit along the wall face, in [-.5, .5) from its middle
+	bool door;		// the hit is on the panel of a door, in the middle of the cell (see Door)
+} RayHit;
+
+// The fixed point backend casts from 16.16 positions along 2.30 directions given as binary angles
+// (2^32 per turn) with integer sine and cosine, so that its hits are bit exact whatever the
+// compiler flags, CPU or math library. The float fields of its RayHits are exact conversions.
+enum RayBackend {
+	RAY_FLOAT,
+	RAY_FIXED
+};
+
+const int FIXED_SHIFT = 16;	// fractional bits of fixed point positions and distances
+const int FIXED_DIR_SHIFT = 30;	// fractional bits of fixed point directions
+
+// walk the grid cell by cell (DDA) from (x, y) along the unit vector dir, stopping at the walls and at the closed
+// part of the door panels (through_doors ignores the doors, as the static lighting does)
+RayHit cast_ray(Map& map, const float x, const float y, const float dir_x, const float dir_y, const float max_dist, const bool through_doors = false);
+RayHit cast_ray_fixed(Map& map, const int32_t x, const int32_t y, const int32_t dir_x, const int32_t dir_y, const int32_t max_dist); // same DDA in fixed point
+int32_t to_fixed(const float value); // 16.16, rounded to nearest
+uint32_t to_binary_angle(const float a); // radians to 2^32 per turn, wraps
+void fixed_sincos(const uint32_t angle, int32_t& c, int32_t& s); // 2.30 cosine and sine, from an integer CORDIC table
+
+#endif
@@ -0,0 +1,905 @@
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+#include <utility>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "utils.h"
+#include "render.h"
+#include "profile.h"
+#include "arena.h"
+
+ViewTables::ViewTables(const size_t w, const float fov, const RayBackend backend) : w(w), fov(fov), first(0), view_w(w), column_scale(1), backend(backend), cos_offset(w), sin_offset(w), angle_offset(), fixed_cos_offset() {
+	if (backend == RAY_FIXED) {
+		angle_offset.resize(w);
+		fixed_cos_offset.resize(w);
+		const int64_t fov_angle = to_binary_angle(fov);
+		for (size_t i = 0; i < w; i++) {
+			int32_t c, s;
+			angle_offset[i] = static_cast<uint32_t>(fov_angle * static_cast<int64_t>(i) / static_cast<int64_t>(w) - fov_angle / 2);
+			fixed_sincos(angle_offset[i], c, s);
+			fixed_cos_offset[i] = c;
+			cos_offset[i] = c / static_cast<float>(1 << FIXED_DIR_SHIFT);
+			sin_offset[i] = s / static_cast<float>(1 << FIXED_DIR_SHIFT);
+		}
+		return;
+	}
+	for (size_t i = 0; i < w; i++) {
+		float offset = -fov / 2 + fov * i / static_cast<float>(w);
+		cos_offset[i] = cos(offset);
+		sin_offset[i] = sin(offset);
+	}
+}
+
+void ViewTables::slice(const ViewTables& view, const size_t begin, const size_t end) {
+	assert(begin <= end && end <= view.w);
+	w = end - begin;
+	fov = view.fov;
+	first = view.first + begin;
+	view_w = view.view_w;
+	column_scale = view.column_scale;
+	backend = view.backend;
+	cos_offset.assign(view.cos_offset.begin() + begin, view.cos_offset.begin() + end);
+	sin_offset.assign(view.sin_offset.begin() + begin, view.sin_offset.begin() + end);
+	if (backend == RAY_FIXED) {
+		angle_offset.assign(view.angle_offset.begin() + begin, view.angle_offset.begin() + end);
+		fixed_cos_offset.assign(view.fixed_cos_offset.begin() + begin, view.fixed_cos_offset.begin() + end);
+	}
+}
+
+void ViewTables::interleave(const ViewTables& view, const size_t phase) {
+	assert(phase < 2 && view.first == 0 && view.w == view.view_w);
+	w = (view.w + 1 - phase) / 2;
+	fov = view.fov;
+	first = 0;
+	view_w = w; // sprites are projected at half the resolution, within a column of their cast position
+	column_scale = view.column_scale / 2;
+	backend = view.backend;
+	cos_offset.resize(w);
+	sin_offset.resize(w);
+	angle_offset.resize(backend == RAY_FIXED ? w : 0);
+	fixed_cos_offset.resize(backend == RAY_FIXED ? w : 0);
+	for (size_t i = 0; i < w; i++) {
+		cos_offset[i] = view.cos_offset[2 * i + phase];
+		sin_offset[i] = view.sin_offset[2 * i + phase];
+		if (backend == RAY_FIXED) {
+			angle_offset[i] = view.angle_offset[2 * i + phase];
+			fixed_cos_offset[i] = view.fixed_cos_offset[2 * i + phase];
+		}
+	}
+}
+
+FrameHistory::FrameHistory() : valid(false), player(), w(0), h(0), map(nullptr), map_version(0), door_version(0), lightmap(nullptr), backend(RAY_FLOAT), pvs(nullptr), sprites(), minimap() {
+}
+
+// texels of the given light level, texel (i, j) of texture idx is at i + idx * size + j * img_w
+static inline const uint32_t* texels(Texture& texture, const size_t level, const uint32_t*) {
+	return texture.pixels(level);
+}
+
+static inline const uint8_t* texels(Texture& texture, const size_t level, const uint8_t*) {
+	return texture.pixels8(level);
+}
+
+// light level of a surface at the camera plane distance dist receiving the (lightmap) light,
+// the per-pixel cost is then only the choice of texels()
+static inline size_t light_level(const float dist, const uint8_t light, Map& map, Texture& texture) {
+	if (!texture.shade_levels) return 0;
+	float fog = map.fog_distance > 0 ? std::min(1.f, dist / map.fog_distance) : 0;
+	float t = 1 - (1 - fog) * light / 255.f;
+	return std::min(texture.shade_levels - 1, static_cast<size_t>(t * (texture.shade_levels - 1)));
+}
+
+static inline uint32_t pixel_color(const uint32_t color, Texture&, const uint32_t*) {
+	return color;
+}
+
+static inline uint8_t pixel_color(const uint32_t color, Texture& texture, const uint8_t*) {
+	return convert_color(color, texture.format8);
+}
+
+int wall_x_texture_coord(const float offset, Texture &texture_walls) {
+	int texture = offset * texture_walls.size;
+	if (texture < 0) { // handle case where x_texture_coord can be negative
+		texture += texture_walls.size;
+	}
+	assert(texture >= 0 && texture < static_cast<int>(texture_walls.size));
+	
+	return texture;
+}
+
+ViewCache::ViewCache(const float tolerance) : valid(false), x(0), y(0), a(0), fov(0), w(0), map(nullptr), map_version(0), door_version(0), tolerance(tolerance), reused(0), cast(0) {
+}
+
+// true if the segment (x0, y0) - (x1, y1) crosses the cell of a door of region, which bounds the doors that moved
+static bool door_crossed(const Map& map, const MapRegion& region, const float x0, const float y0, const float x1, const float y1) {
+	if (region.empty() || !region.crosses(x0, y0, x1, y1)) return false;
+	for (size_t d = 0; d < map.doors.size(); d++) {
+		const Door& door = map.doors[d];
+		if (region.contains(door.i, door.j) && MapRegion(door.i, door.j, door.i + 1, door.j + 1).crosses(x0, y0, x1, y1)) return true;
+	}
+	return false;
+}
+
+void cast_view(Map& map, Player& player, const ViewTables& tables, std::vector<RayHit>& hits, ViewCache* cache) {
+	PROFILE_SCOPE("cast");
+	assert(tables.fov == player.fov && (!cache || tables.w == tables.view_w));
+	size_t begin = 0, end = tables.w; // columns to cast
+	float a = player.a;
+	MapRegion edited, moved; // cells changed and doors moved since the kept hits were cast
+	if (cache && cache->valid && tables.backend == RAY_FLOAT && cache->map == &map && cache->x == player.x && cache->y == player.y && cache->fov == tables.fov && cache->w == tables.w && hits.size() == tables.w) {
+		// Same position: column i now looks where column i + shift looked, and a shift by a whole
+		// number of columns lets the previous hits be moved over instead of cast again.
+		const float step = tables.fov / tables.w;
+		const float delta = std::remainder(player.a - cache->a, static_cast<float>(2 * M_PI));
+		const int shift = std::lround(delta / step);
+		if (std::abs(delta / step - shift) <= cache->tolerance && std::abs(shift) < static_cast<int>(tables.w)) {
+			a = cache->a + shift * step; // the angle every reused hit was cast for, so that errors do not accumulate
+			if (shift > 0) {
+				std::copy(hits.begin() + shift, hits.end(), hits.begin());
+				begin = tables.w - shift;
+			} else {
+				std::copy_backward(hits.begin(), hits.end() + shift, hits.end());
+				end = -shift;
+			}
+			map.changes_since(cache->map_version, edited);
+			map.doors_moved_since(cache->door_version, moved);
+		}
+	}
+	hits.resize(tables.w);
+	size_t recast = 0;
+	if (tables.backend == RAY_FIXED) {
+		const uint32_t angle = to_binary_angle(player.a);
+		const int32_t x = to_fixed(player.x), y = to_fixed(player.y);
+		for (size_t i = begin; i < end; i++) {
+			int32_t ray_x, ray_y;
+			fixed_sincos(angle + tables.angle_offset[i], ray_x, ray_y);
+			hits[i] = cast_ray_fixed(map, x, y, ray_x, ray_y, 20 << FIXED_SHIFT);
+		}
+	} else {
+		const float dir_x = cos(a);
+		const float dir_y = sin(a);
+		for (size_t i = 0; i < tables.w; i++) {
+			// rotate the view direction by the column offset
+			float ray_x = dir_x * tables.cos_offset[i] - dir_y * tables.sin_offset[i];
+			float ray_y = dir_y * tables.cos_offset[i] + dir_x * tables.sin_offset[i];
+			if (i < begin || i >= end) { // kept hit, stale only if its ray (a little past the hit) crosses an edited cell or a moved door
+				const float dist = (hits[i].hit ? hits[i].dist : 20) + .01f;
+				if (!edited.crosses(player.x, player.y, player.x + ray_x * dist, player.y + ray_y * dist) && !door_crossed(map, moved, player.x, player.y, player.x + ray_x * dist, player.y + ray_y * dist)) continue;
+				recast++;
+			}
+			hits[i] = cast_ray(map, player.x, player.y, ray_x, ray_y, 20);
+		}
+	}
+	if (cache) {
+		cache->valid = tables.backend == RAY_FLOAT; // shifted hits are only close to a fresh cast, the fixed point backend always casts them all
+		cache->x = player.x;
+		cache->y = player.y;
+		cache->a = a;
+		cache->fov = tables.fov;
+		cache->w = tables.w;
+		cache->map = &map;
+		cache->map_version = map.version;
+		cache->door_version = map.door_version;
+		cache->cast = end - begin + recast;
+		cache->reused = tables.w - cache->cast;
+	}
+}
+
+void map_show_sprite(const Sprite& sprite, FrameBuffer &fb, Map& map) {
+	const size_t rect_w = fb.w / (map.w * 2);
+	const size_t rect_h = fb.h / map.h;
+	fb.draw_rect(sprite.x * rect_w - 3, sprite.y * rect_h - 3, 6, 6, pack_color(255, 0, 0));
+}
+
+// screen extent [top, top + height) of the wall column hit at the distance dist from the camera plane
+static inline void wall_extent(const float dist, const size_t fb_h, int& top, int& height) {
+	height = std::min(static_cast<float>(fb_h * 16), fb_h / dist);
+	top = static_cast<int>(fb_h / 2) - height / 2;
+}
+
+// Texture size of the column kernels: a compile time constant for the kernels specialized on
+// Texture::kernel_size, so that the divisions, modulos and multiplications by it become shifts and
+// masks, read from the texture by the generic kernel (SIZE = 0).
+template <size_t SIZE> static inline size_t kernel_size(const Texture& texture) {
+	return SIZE ? SIZE : texture.size;
+}
+
+template <typename T, size_t SIZE> static void draw_wall_columns(FrameBufferT<T>& fb, const size_t view_x, const ViewTables& tables, const std::vector<RayHit>& hits, Map& map, Texture& texture_walls, const Lightmap* lightmap, AuxBuffers* aux) {
+	const size_t size = kernel_size<SIZE>(texture_walls);
+	assert(hits.size() == tables.w && view_x + tables.w <= fb.w);
+	assert(!aux || (aux->w == tables.w && aux->h == fb.h));
+	for (size_t i = 0; i < tables.w; i++) {
+		const RayHit& hit = hits[i];
+		if (!hit.hit) continue;
+		assert(hit.texture_id >= 0 && static_cast<size_t>(hit.texture_id) < texture_walls.count);
+		float dist = hit.dist * tables.cos_offset[i]; // distance to the camera plane, avoids the fisheye effect
+		int top, column_height;
+		wall_extent(dist, fb.h, top, column_height);
+		int x_texture_coord = wall_x_texture_coord(hit.offset, texture_walls);
+		int pix_x = i + view_x;
+		int j_begin = std::max(0, -top); // only sample the rows that end up on screen
+		int j_end = std::min(column_height, static_cast<int>(fb.h) - top);
+		const uint8_t light = lightmap ? lightmap->face(hit) : 255;
+		const T* column = texels(texture_walls, light_level(dist, light, map, texture_walls), static_cast<T*>(0)) + x_texture_coord + hit.texture_id * size;
+		// texture row j * size / column_height in 32.32 fixed point, the step is rounded up so that
+		// the row is exact as long as column_height^2 < 2^32 (wall_extent caps it at 16 * fb.h)
+		const uint64_t step = ((static_cast<uint64_t>(size) << 32) + column_height - 1) / column_height;
+		uint64_t v = j_begin * step;
+		for (int j = j_begin; j < j_end; j++, v += step) {
+			fb.set_pixel(pix_x, top + j, column[(v >> 32) * texture_walls.img_w]);
+		}
+		PROFILE_COUNT(texels, j_end - j_begin);
+		PROFILE_COUNT(pixels, j_end - j_begin);
+		if (aux) {
+			for (int j = j_begin; j < j_end; j++) {
+				aux->set(i, top + j, dist, LABEL_WALL | hit.texture_id);
+			}
+		}
+	}
+}
+
+template <typename T> void draw_walls(FrameBufferT<T>& fb, const size_t view_x, const ViewTables& tables, const std::vector<RayHit>& hits, Map& map, Texture& texture_walls, const Lightmap* lightmap, AuxBuffers* aux) {
+	PROFILE_SCOPE("walls");
+	switch (texture_walls.kernel_size) {
+		case 64: draw_wall_columns<T, 64>(fb, view_x, tables, hits, map, texture_walls, lightmap, aux); break;
+		case 128: draw_wall_columns<T, 128>(fb, view_x, tables, hits, map, texture_walls, lightmap, aux); break;
+		default: draw_wall_columns<T, 0>(fb, view_x, tables, hits, map, texture_walls, lightmap, aux);
+	}
+}
+
+template <typename T, size_t SIZE> static void draw_floor_rows(FrameBufferT<T>& fb, const size_t view_x, const ViewTables& tables, const std::vector<RayHit>& hits, Map& map, Player& player, Texture& texture_walls, const Lightmap* lightmap, AuxBuffers* aux) {
+	assert(hits.size() == tables.w && view_x + tables.w <= fb.w);
+	assert(map.floor_texture < static_cast<int>(texture_walls.count) && map.ceiling_texture < static_cast<int>(texture_walls.count));
+	const size_t w = tables.w;
+	const size_t size = kernel_size<SIZE>(texture_walls);
+
+	// Per column, the floor point seen at camera plane distance d is player + d * (ray_x, ray_y),
+	// so one row only needs d and then a multiply-add per pixel. The columns are spaced by angle,
+	// not linearly along the camera plane, hence the per-column table instead of a constant step.
+	FrameArena& arena = frame_arena();
+	float* ray_x = arena.alloc<float>(w);
+	float* ray_y = arena.alloc<float>(w);
+	int* wall_top = arena.alloc<int>(w);
+	int* wall_bottom = arena.alloc<int>(w);
+	const bool fixed = tables.backend == RAY_FIXED; // 16.16 rays in texels per unit of d, see cast_ray_fixed
+	int32_t* fixed_ray_x = fixed ? arena.alloc<int32_t>(w) : nullptr;
+	int32_t* fixed_ray_y = fixed ? arena.alloc<int32_t>(w) : nullptr;
+	const float dir_x = cos(player.a);
+	const float dir_y = sin(player.a);
+	const uint32_t angle = to_binary_angle(player.a);
+	for (size_t i = 0; i < w; i++) {
+		if (fixed) {
+			int32_t c, s;
+			fixed_sincos(angle + tables.angle_offset[i], c, s);
+			fixed_ray_x[i] = (static_cast<int64_t>(c) << FIXED_SHIFT) * static_cast<int64_t>(size) / tables.fixed_cos_offset[i];
+			fixed_ray_y[i] = (static_cast<int64_t>(s) << FIXED_SHIFT) * static_cast<int64_t>(size) / tables.fixed_cos_offset[i];
+		} else {
+			ray_x[i] = (dir_x * tables.cos_offset[i] - dir_y * tables.sin_offset[i]) / tables.cos_offset[i];
+			ray_y[i] = (dir_y * tables.cos_offset[i] + dir_x * tables.sin_offset[i]) / tables.cos_offset[i];
+		}
+		int height = 0;
+		wall_top[i] = fb.h / 2;
+		if (hits[i].hit) wall_extent(hits[i].dist * tables.cos_offset[i], fb.h, wall_top[i], height);
+		wall_bottom[i] = wall_top[i] + height;
+	}
+
+	// the floor row y and the ceiling row fb.h - 1 - y look at the same map point
+	int* world_x = arena.alloc<int>(w); // in texels, i.e. map coordinates * size
+	int* world_y = arena.alloc<int>(w);
+	const float origin_x = player.x * size;
+	const float origin_y = player.y * size;
+	const int64_t fixed_origin_x = static_cast<int64_t>(to_fixed(player.x)) * size;
+	const int64_t fixed_origin_y = static_cast<int64_t>(to_fixed(player.y)) * size;
+	const size_t buckets = 32; // lightmap values are bucketed to pick a precomputed texel pointer per pixel
+	const T* floor_texels[buckets];
+	const T* ceiling_texels[buckets];
+	for (int y = fb.h / 2; y < static_cast<int>(fb.h); y++) {
+		const int ceiling_y = fb.h - 1 - y;
+		const float d = fb.h / (2.f * (y + .5f) - fb.h); // camera plane distance of the row
+		for (size_t b = 0; b < buckets; b++) {
+			if (b && !lightmap) {
+				floor_texels[b] = floor_texels[0];
+				ceiling_texels[b] = ceiling_texels[0];
+				continue;
+			}
+			const T* pixels = texels(texture_walls, light_level(d, lightmap ? b * 255 / (buckets - 1) : 255, map, texture_walls), static_cast<T*>(0));
+			floor_texels[b] = pixels + map.floor_texture * size;
+			ceiling_texels[b] = pixels + map.ceiling_texture * size;
+		}
+		if (fixed) {
+			const int32_t fixed_d = (static_cast<int64_t>(fb.h) << FIXED_SHIFT) / (2 * y + 1 - static_cast<int>(fb.h));
+			for (size_t i = 0; i < w; i++) { // 32 x 32 -> 64 bit products, also vectorized
+				world_x[i] = (fixed_origin_x + (static_cast<int64_t>(fixed_d) * fixed_ray_x[i] >> FIXED_SHIFT)) >> FIXED_SHIFT;
+				world_y[i] = (fixed_origin_y + (static_cast<int64_t>(fixed_d) * fixed_ray_y[i] >> FIXED_SHIFT)) >> FIXED_SHIFT;
+			}
+		} else {
+			for (size_t i = 0; i < w; i++) { // kept free of branches so that it vectorizes
+				world_x[i] = static_cast<int>(origin_x + d * size * ray_x[i]);
+				world_y[i] = static_cast<int>(origin_y + d * size * ray_y[i]);
+			}
+		}
+		for (size_t i = 0; i < w; i++) {
+			if (world_x[i] < 0 || world_y[i] < 0) continue; // outside of the map
+			const size_t texel_x = world_x[i], texel_y = world_y[i]; // unsigned, so that / and % by a power of two size are shifts and masks
+			const size_t cell_x = texel_x / size;
+			const size_t cell_y = texel_y / size;
+			if (cell_x >= map.w || cell_y >= map.h) continue;
+			const size_t offset = texel_x % size + texel_y % size * texture_walls.img_w;
+			const size_t bucket = lightmap ? lightmap->cell(cell_x, cell_y) * (buckets - 1) / 255 : 0;
+			if (map.floor_texture >= 0 && y >= wall_bottom[i]) {
+				fb.set_pixel(view_x + i, y, floor_texels[bucket][offset]);
+				PROFILE_COUNT(texels, 1);
+				PROFILE_COUNT(pixels, 1);
+				if (aux) aux->set(i, y, d, LABEL_FLOOR | map.floor_texture);
+			}
+			if (map.ceiling_texture >= 0 && ceiling_y < wall_top[i]) {
+				fb.set_pixel(view_x + i, ceiling_y, ceiling_texels[bucket][offset]);
+				PROFILE_COUNT(texels, 1);
+				PROFILE_COUNT(pixels, 1);
+				if (aux) aux->set(i, ceiling_y, d, LABEL_CEILING | map.ceiling_texture);
+			}
+		}
+	}
+}
+
+template <typename T> void draw_floor(FrameBufferT<T>& fb, const size_t view_x, const ViewTables& tables, const std::vector<RayHit>& hits, Map& map, Player& player, Texture& texture_walls, const Lightmap* lightmap, AuxBuffers* aux) {
+	if (map.floor_texture < 0 && map.ceiling_texture < 0) return;
+	PROFILE_SCOPE("floor");
+	switch (texture_walls.kernel_size) {
+		case 64: draw_floor_rows<T, 64>(fb, view_x, tables, hits, map, player, texture_walls, lightmap, aux); break;
+		case 128: draw_floor_rows<T, 128>(fb, view_x, tables, hits, map, player, texture_walls, lightmap, aux); break;
+		default: draw_floor_rows<T, 0>(fb, view_x, tables, hits, map, player, texture_walls, lightmap, aux);
+	}
+}
+
+// atan2(y, x) by the polynomial of Cephes' atanf on the ratio reduced to [-tan(pi/8), tan(pi/8)], within
+// a few 1e-7 and with exactly the operations of its SSE2 version in project_sprites(), so that both agree
+static inline float sprite_atan2(const float y, const float x) {
+	const float ax = std::abs(x), ay = std::abs(y);
+	const float hi = std::max(ax, ay), lo = std::min(ax, ay);
+	const float t = hi > 0 ? lo / hi : 0;
+	const bool big = t > .41421356f;
+	const float u = big ? (t - 1) / (t + 1) : t;
+	const float z = u * u;
+	const float poly = ((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z - 3.33329491539e-1f;
+	float a = (big ? static_cast<float>(M_PI / 4) : 0) + (poly * z * u + u);
+	a = ay > ax ? static_cast<float>(M_PI / 2) - a : a;
+	a = x < 0 ? static_cast<float>(M_PI) - a : a;
+	return y < 0 ? -a : a;
+}
+
+static inline float floor_float(const float x) { // as _mm_cvttps_epi32 then a correction below 0
+	const float f = static_cast<float>(static_cast<int>(x));
+	return f - (f > x ? 1 : 0);
+}
+
+// rotation bucket of a sprite facing facing seen at angle from the view direction, see SpriteSequence
+static inline int sprite_bucket(const float angle, const Player& player, const float facing, const int rotations) {
+	const float turns = (angle + player.a + static_cast<float>(M_PI) - facing) / static_cast<float>(2 * M_PI);
+	const int bucket = static_cast<int>((turns - floor_float(turns)) * rotations + .5f);
+	return bucket - (bucket > rotations - 1 ? rotations : 0);
+}
+
+// camera transform of the sprite at (x, y), c and s are the cosine and sine of the view direction
+static inline void sprite_camera(const float x, const float y, const Player& player, const float c, const float s, const size_t view_w, const size_t view_h, float& angle, float& dist, float& depth, int& h_offset, int& v_offset, int& size) {
+	const float dx = x - player.x, dy = y - player.y;
+	const float forward = dx * c + dy * s, side = dy * c - dx * s; // rotated into the view direction
+	angle = sprite_atan2(side, forward);
+	dist = std::sqrt(dx * dx + dy * dy);
+	depth = forward; // same camera plane distance as the walls
+	size = forward > SPRITE_NEAR ? static_cast<int>(std::min(1000.f, view_h / dist)) : 0; // screen sprite size, none at or behind the camera plane
+	h_offset = static_cast<int>(angle / player.fov * view_w + static_cast<float>(view_w / 2) - static_cast<float>(size / 2));
+	v_offset = static_cast<int>(view_h / 2) - size / 2;
+}
+
+// view direction of the player, from the binary angle and the CORDIC table with the fixed point backend so
+// that its sprites do not depend on libm either
+static inline void view_direction(const Player& player, const RayBackend backend, float& c, float& s) {
+	if (backend == RAY_FIXED) {
+		int32_t fixed_c, fixed_s;
+		fixed_sincos(to_binary_angle(player.a), fixed_c, fixed_s);
+		c = fixed_c / static_cast<float>(1 << 30);
+		s = fixed_s / static_cast<float>(1 << 30);
+	} else {
+		c = std::cos(player.a);
+		s = std::sin(player.a);
+	}
+}
+
+void project_sprite(const Sprite& sprite, const Player& player, const size_t view_w, const size_t view_h, int& h_offset, int& v_offset, int& size, float& depth, const RayBackend backend) {
+	float angle, dist, c, s;
+	view_direction(player, backend, c, s);
+	sprite_camera(sprite.x, sprite.y, player, c, s, view_w, view_h, angle, dist, depth, h_offset, v_offset, size);
+}
+
+void project_sprites(const SpriteSet& sprites, const Player& player, const size_t view_w, const size_t view_h, SpriteProjection& projection, const RayBackend backend) {
+	PROFILE_SCOPE("project_sprites");
+	const size_t n = sprites.size();
+	FrameArena& arena = frame_arena();
+	projection.n = n;
+	projection.angle = arena.alloc<float>(n);
+	projection.dist = arena.alloc<float>(n);
+	projection.depth = arena.alloc<float>(n);
+	projection.h_offset = arena.alloc<int>(n);
+	projection.v_offset = arena.alloc<int>(n);
+	projection.size = arena.alloc<int>(n);
+	projection.tile = arena.alloc<size_t>(n);
+	float c, s;
+	view_direction(player, backend, c, s);
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128 px = _mm_set1_ps(player.x), py = _mm_set1_ps(player.y), cos_a = _mm_set1_ps(c), sin_a = _mm_set1_ps(s);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1), sign = _mm_set1_ps(-0.f);
+	const __m128 pi = _mm_set1_ps(M_PI), half_pi = _mm_set1_ps(M_PI / 2), quarter_pi = _mm_set1_ps(M_PI / 4), tan_eighth = _mm_set1_ps(.41421356f);
+	const __m128 p0 = _mm_set1_ps(8.05374449538e-2f), p1 = _mm_set1_ps(1.38776856032e-1f), p2 = _mm_set1_ps(1.99777106478e-1f), p3 = _mm_set1_ps(3.33329491539e-1f);
+	const __m128 fov = _mm_set1_ps(player.fov), width = _mm_set1_ps(view_w), height = _mm_set1_ps(view_h), largest = _mm_set1_ps(1000), near = _mm_set1_ps(SPRITE_NEAR);
+	const __m128 half_width = _mm_set1_ps(static_cast<float>(view_w / 2));
+	const __m128i half_height = _mm_set1_epi32(static_cast<int>(view_h / 2));
+	const __m128 view_a = _mm_set1_ps(player.a), turn = _mm_set1_ps(2 * M_PI), half = _mm_set1_ps(.5f);
+	const __m128i int_one = _mm_set1_epi32(1);
+	for (; i + 4 <= n; i += 4) { // sprite_camera() of 4 sprites at a time
+		const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&sprites.x[i]), px), dy = _mm_sub_ps(_mm_loadu_ps(&sprites.y[i]), py);
+		const __m128 forward = _mm_add_ps(_mm_mul_ps(dx, cos_a), _mm_mul_ps(dy, sin_a));
+		const __m128 side = _mm_sub_ps(_mm_mul_ps(dy, cos_a), _mm_mul_ps(dx, sin_a));
+
+		const __m128 ax = _mm_andnot_ps(sign, forward), ay = _mm_andnot_ps(sign, side);
+		const __m128 hi = _mm_max_ps(ax, ay), lo = _mm_min_ps(ax, ay);
+		const __m128 t = _mm_and_ps(_mm_cmpgt_ps(hi, zero), _mm_div_ps(lo, hi));
+		const __m128 big = _mm_cmpgt_ps(t, tan_eighth);
+		const __m128 u = _mm_or_ps(_mm_and_ps(big, _mm_div_ps(_mm_sub_ps(t, one), _mm_add_ps(t, one))), _mm_andnot_ps(big, t));
+		const __m128 z = _mm_mul_ps(u, u);
+		const __m128 poly = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(p0, z), p1), z), p2), z), p3);
+		__m128 angle = _mm_add_ps(_mm_and_ps(big, quarter_pi), _mm_add_ps(_mm_mul_ps(_mm_mul_ps(poly, z), u), u));
+		const __m128 steep = _mm_cmpgt_ps(ay, ax), behind = _mm_cmplt_ps(forward, zero);
+		angle = _mm_or_ps(_mm_and_ps(steep, _mm_sub_ps(half_pi, angle)), _mm_andnot_ps(steep, angle));
+		angle = _mm_or_ps(_mm_and_ps(behind, _mm_sub_ps(pi, angle)), _mm_andnot_ps(behind, angle));
+		angle = _mm_xor_ps(angle, _mm_and_ps(_mm_cmplt_ps(side, zero), sign));
+
+		const __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+		const __m128i size = _mm_cvttps_epi32(_mm_and_ps(_mm_cmpgt_ps(forward, near), _mm_min_ps(largest, _mm_div_ps(height, dist))));
+		const __m128 half_size = _mm_cvtepi32_ps(_mm_srai_epi32(size, 1)); // size >= 0
+		const __m128i h_offset = _mm_cvttps_epi32(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_div_ps(angle, fov), width), half_width), half_size));
+		_mm_storeu_ps(&projection.angle[i], angle);
+		_mm_storeu_ps(&projection.dist[i], dist);
+		_mm_storeu_ps(&projection.depth[i], forward);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&projection.size[i]), size);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&projection.h_offset[i]), h_offset);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(&projection.v_offset[i]), _mm_sub_epi32(half_height, _mm_srai_epi32(size, 1)));
+
+		const __m128i rotations = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&sprites.rotations[i])); // sprite_bucket()
+		const __m128 turns = _mm_div_ps(_mm_sub_ps(_mm_add_ps(_mm_add_ps(angle, view_a), pi), _mm_loadu_ps(&sprites.facing[i])), turn);
+		__m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(turns));
+		whole = _mm_sub_ps(whole, _mm_and_ps(_mm_cmpgt_ps(whole, turns), one));
+		__m128i bucket = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(turns, whole), _mm_cvtepi32_ps(rotations)), half));
+		bucket = _mm_sub_epi32(bucket, _mm_and_si128(_mm_cmpgt_epi32(bucket, _mm_sub_epi32(rotations, int_one)), rotations));
+		int buckets[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(buckets), bucket);
+		for (size_t l = 0; l < 4; l++) {
+			projection.tile[i + l] = sprites.texture_id[i + l] + buckets[l];
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		sprite_camera(sprites.x[i], sprites.y[i], player, c, s, view_w, view_h, projection.angle[i], projection.dist[i], projection.depth[i], projection.h_offset[i], projection.v_offset[i], projection.size[i]);
+		projection.tile[i] = sprites.texture_id[i] + sprite_bucket(projection.angle[i], player, sprites.facing[i], sprites.rotations[i]);
+	}
+}
+
+template <typename T> void draw_sprite(const SpriteSet& sprites, const SpriteProjection& projection, const size_t sprite_index, FrameBufferT<T>& fb, const size_t view_x, const ViewTables& tables, Map& map, Texture& texture_sprites, const Lightmap* lightmap, AuxBuffers* aux) {
+	assert(sprite_index < projection.n);
+	const int sprite_screen_size = projection.size[sprite_index], v_offset = projection.v_offset[sprite_index];
+	const float depth = projection.depth[sprite_index];
+	int h_offset = projection.h_offset[sprite_index];
+	int sprite_w = sprite_screen_size;
+	if (tables.column_scale != 1) { // the view is stretched horizontally afterwards, keep the sprite square on screen
+		const int center = h_offset + sprite_screen_size / 2;
+		sprite_w = std::max(1, static_cast<int>(sprite_screen_size * tables.column_scale));
+		h_offset = center - sprite_w / 2;
+	}
+	h_offset -= tables.first; // relative to the drawn slice of the view
+	const size_t level = light_level(depth, lightmap ? lightmap->cell(sprites.x[sprite_index], sprites.y[sprite_index]) : 255, map, texture_sprites);
+	const size_t tile = projection.tile[sprite_index], size = texture_sprites.size;
+	assert(tile < texture_sprites.count);
+	const T* pixels = texels(texture_sprites, level, static_cast<T*>(0)) + tile * size;
+	const uint32_t* alpha = texture_sprites.img.data() + tile * size; // cut out where the texel is mostly transparent
+
+	const int i_begin = std::max(0, -h_offset), i_end = std::min(sprite_w, static_cast<int>(tables.w) - h_offset); // clip to the view
+	const int j_begin = std::max(0, -v_offset), j_end = std::min(sprite_screen_size, static_cast<int>(fb.h) - v_offset);
+	if (i_begin >= i_end || j_begin >= j_end) {
+		PROFILE_COUNT(sprites_culled, 1);
+		return;
+	}
+	PROFILE_COUNT(sprites_drawn, 1);
+	PROFILE_COUNT(pixels, (i_end - i_begin) * (j_end - j_begin));
+
+	for (int i=i_begin; i<i_end; i++) {
+		const size_t u = i * size / sprite_w;
+		for (int j=j_begin; j<j_end; j++) {
+			const size_t texel = u + j * size / sprite_screen_size * texture_sprites.img_w;
+			if (alpha[texel] >> 24 < 128) continue;
+		    fb.set_pixel(view_x + h_offset+i, v_offset+j, pixels[texel]);
+		    if (aux) aux->set(h_offset+i, v_offset+j, depth, LABEL_SPRITE | sprite_index);
+		}
+	}
+
+}
+
+// sprites standing in cells the PVS hides from the player are skipped
+static inline bool sprite_visible(const PVS* pvs, const Player& player, const SpriteSet& sprites, const size_t i) {
+	return !pvs || pvs->visible_from(player.x, player.y, sprites.x[i], sprites.y[i]);
+}
+
+template <typename T> void render_view(FrameBufferT<T>& fb, const size_t view_x, const ViewTables& tables, std::vector<RayHit>& hits, Map& map, Player& player, const SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, const Lightmap* lightmap, AuxBuffers* aux, ViewCache* cache, const PVS* pvs) {
+	PROFILE_FRAME();
+	ArenaFrame frame;
+	cast_view(map, player, tables, hits, cache);
+	draw_walls(fb, view_x, tables, hits, map, texture_walls, lightmap, aux);
+	draw_floor(fb, view_x, tables, hits, map, player, texture_walls, lightmap, aux);
+	PROFILE_SCOPE("sprites");
+	SpriteProjection projection;
+	project_sprites(sprites, player, tables.view_w, fb.h, projection, tables.backend);
+	for (size_t i = 0; i < sprites.size(); i++) {
+		if (!sprite_visible(pvs, player, sprites, i)) continue;
+		draw_sprite(sprites, projection, i, fb, view_x, tables, map, texture_monsters, lightmap, aux);
+	}
+}
+
+template void draw_walls(FrameBuffer&, const size_t, const ViewTables&, const std::vector<RayHit>&, Map&, Texture&, const Lightmap*, AuxBuffers*);
+template void draw_walls(FrameBuffer8&, const size_t, const ViewTables&, const std::vector<RayHit>&, Map&, Texture&, const Lightmap*, AuxBuffers*);
+template void draw_floor(FrameBuffer&, const size_t, const ViewTables&, const std::vector<RayHit>&, Map&, Player&, Texture&, const Lightmap*, AuxBuffers*);
+template void draw_floor(FrameBuffer8&, const size_t, const ViewTables&, const std::vector<RayHit>&, Map&, Player&, Texture&, const Lightmap*, AuxBuffers*);
+template void draw_sprite(const SpriteSet&, const SpriteProjection&, const size_t, FrameBuffer&, const size_t, const ViewTables&, Map&, Texture&, const Lightmap*, AuxBuffers*);
+template void draw_sprite(const SpriteSet&, const SpriteProjection&, const size_t, FrameBuffer8&, const size_t, const ViewTables&, Map&, Texture&, const Lightmap*, AuxBuffers*);
+template void render_view(FrameBuffer&, const size_t, const ViewTables&, std::vector<RayHit>&, Map&, Player&, const SpriteSet&, Texture&, Texture&, const Lightmap*, AuxBuffers*, ViewCache*, const PVS*);
+template void render_view(FrameBuffer8&, const size_t, const ViewTables&, std::vector<RayHit>&, Map&, Player&, const SpriteSet&, Texture&, Texture&, const Lightmap*, AuxBuffers*, ViewCache*, const PVS*);
+
+static bool same_pose(const Player& a, const Player& b) {
+	return a.x == b.x && a.y == b.y && a.a == b.a && a.fov == b.fov;
+}
+
+static bool same_sprite(const SpriteSet& a, const SpriteSet& b, const size_t i) {
+	return a.x[i] == b.x[i] && a.y[i] == b.y[i] && a.texture_id[i] == b.texture_id[i] && a.facing[i] == b.facing[i] && a.rotations[i] == b.rotations[i];
+}
+
+// map rectangle of the marker drawn by map_show_sprite, clipped to the map half of fb
+static Rect sprite_marker(const Sprite& sprite, const FrameBuffer& fb, Map& map) {
+	const int rect_w = fb.w / (map.w * 2);
+	const int rect_h = fb.h / map.h;
+	const int x = sprite.x * rect_w - 3, y = sprite.y * rect_h - 3;
+	const int x0 = std::max(0, x), y0 = std::max(0, y);
+	const int x1 = std::min(static_cast<int>(fb.w / 2), x + 6), y1 = std::min(static_cast<int>(fb.h), y + 6);
+	return Rect{static_cast<size_t>(x0), static_cast<size_t>(y0), static_cast<size_t>(std::max(0, x1 - x0)), static_cast<size_t>(std::max(0, y1 - y0))};
+}
+
+static bool overlap(const Rect& a, const Rect& b) {
+	return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+// redraw what the sprites that changed since history touch, false when a full frame is needed
+static bool render_sprites_only(FrameBuffer& fb, FrameHistory& history, const ViewTables& tables, Map& map, Player& player, const SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, const Lightmap* lightmap, const PVS* pvs) {
+	if (!history.valid || history.backend != tables.backend || history.pvs != pvs || history.map != &map || history.map_version != map.version || history.door_version != map.door_version || history.lightmap != lightmap || history.w != fb.w || history.h != fb.h || !same_pose(history.player, player)) return false;
+	if (history.sprites.size() != sprites.size() || fb.img.size() != fb.w * fb.h) return false;
+	PROFILE_SCOPE("sprites_only");
+
+	FrameArena& arena = frame_arena();
+	std::pair<int, int>* ranges = arena.alloc<std::pair<int, int> >(sprites.size() * 2); // view columns [begin, end) left or entered by a sprite
+	Rect* markers = arena.alloc<Rect>(sprites.size() * 2); // map rectangles left or entered by a sprite
+	size_t nranges = 0, nmarkers = 0;
+	for (size_t k = 0; k < sprites.size(); k++) {
+		if (same_sprite(sprites, history.sprites, k)) continue;
+		const Sprite states[2] = {history.sprites.get(k), sprites.get(k)};
+		for (int s = 0; s < 2; s++) {
+			int h_offset, v_offset, size;
+			float depth;
+			project_sprite(states[s], player, tables.w, fb.h, h_offset, v_offset, size, depth, tables.backend);
+			const int begin = std::max(0, h_offset), end = std::min(static_cast<int>(tables.w), h_offset + size);
+			if (begin < end) {
+				ranges[nranges++] = std::make_pair(begin, end);
+				const int top = std::max(0, v_offset), bottom = std::min(static_cast<int>(fb.h), v_offset + size);
+				if (top < bottom) fb.mark_dirty(fb.w / 2 + begin, top, end - begin, bottom - top); // walls and floor redraw the same around it
+			}
+			markers[nmarkers++] = sprite_marker(states[s], fb, map);
+		}
+	}
+
+	// restore the map under the markers that moved, then draw again every marker overlapping them
+	const size_t map_w = fb.w / 2;
+	for (size_t m = 0; m < nmarkers; m++) {
+		const Rect& r = markers[m];
+		for (size_t y = r.y; y < r.y + r.h; y++) {
+			std::copy(&history.minimap[r.x + y * map_w], &history.minimap[r.x + y * map_w] + r.w, &fb.img[r.x + y * fb.w]);
+		}
+		fb.mark_dirty(r.x, r.y, r.w, r.h);
+	}
+	for (size_t i = 0; i < sprites.size(); i++) {
+		const Sprite sprite = sprites.get(i);
+		const Rect marker = sprite_marker(sprite, fb, map);
+		for (size_t m = 0; m < nmarkers && sprite_visible(pvs, player, sprites, i); m++) {
+			if (!overlap(marker, markers[m])) continue;
+			map_show_sprite(sprite, fb, map);
+			break;
+		}
+	}
+
+	// redraw the merged column ranges of the view with every sprite clipped to them
+	std::sort(ranges, ranges + nranges);
+	SpriteProjection projection;
+	project_sprites(sprites, player, tables.view_w, fb.h, projection, tables.backend);
+	thread_local ViewTables slice(0, 0);
+	thread_local std::vector<RayHit> slice_hits;
+	const uint32_t white = pack_color(255, 255, 255);
+	for (size_t r = 0; r < nranges;) {
+		int begin = ranges[r].first, end = ranges[r].second;
+		for (r++; r < nranges && ranges[r].first <= end; r++) {
+			end = std::max(end, ranges[r].second);
+		}
+		slice.slice(tables, begin, end);
+		const size_t view_x = fb.w / 2 + begin;
+		for (size_t y = 0; y < fb.h; y++) {
+			std::fill(&fb.img[view_x + y * fb.w], &fb.img[view_x + y * fb.w] + slice.w, white);
+		}
+		cast_view(map, player, slice, slice_hits);
+		draw_walls(fb, view_x, slice, slice_hits, map, texture_walls, lightmap);
+		draw_floor(fb, view_x, slice, slice_hits, map, player, texture_walls, lightmap);
+		for (size_t i = 0; i < sprites.size(); i++) {
+			if (!sprite_visible(pvs, player, sprites, i)) continue;
+			draw_sprite(sprites, projection, i, fb, view_x, slice, map, texture_monsters, lightmap);
+		}
+	}
+	history.sprites = sprites;
+	return true;
+}
+
+Interleave::Interleave(const float tolerance) : valid(false), phase(0), player(), w(0), h(0), map(nullptr), map_version(0), door_version(0), lightmap(nullptr), backend(RAY_FLOAT), pvs(nullptr), sprites(), view(), cast(), tolerance(tolerance), reused(0), interpolated(0) {
+}
+
+static inline uint32_t average_color(const uint32_t a, const uint32_t b) { // per channel, rounded down
+	return (a & b) + (((a ^ b) & 0xfefefefe) >> 1);
+}
+
+// cast the columns of one parity of the tables.w x fb.h view at view_x into fb, fill the others and remember the view
+// in state; hits receives a hit per view column, the cast one or its neighbour's
+static void render_interleaved(FrameBuffer& fb, const size_t view_x, const ViewTables& tables, std::vector<RayHit>& hits, Map& map, Player& player, const SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, const Lightmap* lightmap, AuxBuffers* aux, const PVS* pvs, Interleave& state) {
+	thread_local ViewTables half(0, 0);
+	thread_local std::vector<RayHit> half_hits;
+	thread_local FrameBuffer cast{0, 0, std::vector<uint32_t>()};
+	const size_t w = tables.w, phase = state.phase ^ 1;
+	half.interleave(tables, phase);
+	cast.w = half.w;
+	cast.h = fb.h;
+	cast.clear(pack_color(255, 255, 255));
+	if (aux) {
+		aux->w = half.w;
+		aux->clear();
+	}
+	render_view(cast, 0, half, half_hits, map, player, sprites, texture_walls, texture_monsters, lightmap, aux, nullptr, pvs);
+	hits.resize(w);
+	for (size_t x = 0; x < w; x++) {
+		hits[x] = half_hits[std::min(x / 2, half.w - 1)];
+	}
+
+	PROFILE_SCOPE("interleave");
+	// a pure rotation by shift columns moves the previous column x + shift to x
+	int shift = 0;
+	bool reuse = state.valid && state.w == w && state.h == fb.h && state.map == &map && state.map_version == map.version && state.door_version == map.door_version && state.lightmap == lightmap && state.backend == tables.backend && state.pvs == pvs && state.player.x == player.x && state.player.y == player.y && state.player.fov == player.fov;
+	if (reuse) {
+		const float delta = std::remainder(player.a - state.player.a, static_cast<float>(2 * M_PI)) / (tables.fov / w);
+		shift = std::lround(delta);
+		reuse = std::abs(delta - shift) <= state.tolerance && std::abs(shift) < static_cast<int>(w);
+	}
+	reuse = reuse && state.sprites.size() == sprites.size();
+	// the columns a sprite that changed covered in the previous frame or covers now are cast again below
+	// rather than reused, as render_sprites_only() redraws them
+	bool* moved = frame_arena().alloc<bool>(w);
+	std::fill(moved, moved + w, false);
+	for (size_t k = 0; reuse && k < sprites.size(); k++) {
+		if (same_sprite(sprites, state.sprites, k)) continue;
+		const Sprite states[2] = {state.sprites.get(k), sprites.get(k)};
+		const Player* viewers[2] = {&state.player, &player};
+		for (int s = 0; s < 2; s++) {
+			int h_offset, v_offset, size;
+			float depth;
+			project_sprite(states[s], *viewers[s], tables.view_w, fb.h, h_offset, v_offset, size, depth, tables.backend);
+			const int sprite_w = tables.column_scale != 1 ? std::max(1, static_cast<int>(size * tables.column_scale)) : size; // as draw_sprite()
+			const int left = h_offset + size / 2 - sprite_w / 2 - (s ? 0 : shift); // previous columns move by -shift
+			const int begin = std::max(0, left), end = std::min(static_cast<int>(w), left + sprite_w);
+			if (begin < end) std::fill(moved + begin, moved + end, true);
+		}
+	}
+	state.reused = state.interpolated = 0;
+	int* source = frame_arena().alloc<int>(w); // per column: index in cast (>= 0), previous column (-1 - x) or the neighbours (w)
+	for (size_t x = 0; x < w; x++) {
+		const int previous = static_cast<int>(x) + shift;
+		if (x % 2 == phase) {
+			source[x] = x / 2;
+		} else if (moved[x]) {
+			source[x] = w; // overwritten by the cast below
+		} else if (reuse && previous >= 0 && previous < static_cast<int>(w) && state.cast[previous]) {
+			source[x] = -1 - previous;
+			state.reused++;
+		} else {
+			source[x] = w;
+			state.interpolated++;
+		}
+	}
+	for (size_t y = 0; y < fb.h; y++) {
+		const uint32_t* row = &cast.img[y * cast.w];
+		const uint32_t* previous_row = reuse ? &state.view[y * w] : nullptr;
+		uint32_t* out = &fb.img[view_x + y * fb.w];
+		for (size_t x = 0; x < w; x++) {
+			if (source[x] >= 0 && source[x] < static_cast<int>(w)) {
+				out[x] = row[source[x]];
+			} else if (source[x] < 0) {
+				out[x] = previous_row[-1 - source[x]];
+			} else { // between the cast columns (x - 1) / 2 and (x + 1) / 2, or next to only one at the edges
+				const size_t left = x ? (x - 1) / 2 : 0, right = std::min((x + 1) / 2, cast.w - 1);
+				out[x] = average_color(row[x ? left : right], row[x + 1 < w ? right : left]);
+			}
+		}
+	}
+	thread_local ViewTables slice(0, 0);
+	thread_local std::vector<RayHit> slice_hits;
+	SpriteProjection projection;
+	bool projected = false;
+	for (size_t begin = 0; begin < w; begin++) { // cast the runs of moved columns as render_sprites_only() does
+		if (!moved[begin]) continue;
+		size_t end = begin + 1;
+		while (end < w && moved[end]) end++;
+		if (!projected) project_sprites(sprites, player, tables.view_w, fb.h, projection, tables.backend);
+		projected = true;
+		slice.slice(tables, begin, end);
+		for (size_t y = 0; y < fb.h; y++) {
+			std::fill(&fb.img[view_x + begin + y * fb.w], &fb.img[view_x + end + y * fb.w], pack_color(255, 255, 255));
+		}
+		cast_view(map, player, slice, slice_hits);
+		draw_walls(fb, view_x + begin, slice, slice_hits, map, texture_walls, lightmap);
+		draw_floor(fb, view_x + begin, slice, slice_hits, map, player, texture_walls, lightmap);
+		for (size_t i = 0; i < sprites.size(); i++) {
+			if (!sprite_visible(pvs, player, sprites, i)) continue;
+			draw_sprite(sprites, projection, i, fb, view_x + begin, slice, map, texture_monsters, lightmap);
+		}
+		std::copy(slice_hits.begin(), slice_hits.end(), hits.begin() + begin);
+		begin = end;
+	}
+
+	state.valid = true;
+	state.phase = phase;
+	state.player = player;
+	state.w = w;
+	state.h = fb.h;
+	state.map = &map;
+	state.map_version = map.version;
+	state.door_version = map.door_version;
+	state.lightmap = lightmap;
+	state.backend = tables.backend;
+	state.pvs = pvs;
+	state.sprites = sprites;
+	state.view.resize(w * fb.h);
+	for (size_t y = 0; y < fb.h; y++) {
+		std::copy(&fb.img[view_x + y * fb.w], &fb.img[view_x + y * fb.w] + w, &state.view[y * w]);
+	}
+	state.cast.resize(w);
+	for (size_t x = 0; x < w; x++) {
+		state.cast[x] = x % 2 == phase || moved[x];
+	}
+}
+
+void render(FrameBuffer& fb, Map& map, Player& player, const SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, const Lightmap* lightmap, AuxBuffers* aux, FrameHistory* history, const RayBackend backend, size_t view_columns, Interleave* interleave, const PVS* pvs) {
+	PROFILE_SCOPE("render");
+	ArenaFrame frame;
+	// kept from one call to the next so that a steady sequence of frames does not allocate
+	thread_local ViewTables tables(0, 0);
+	thread_local std::vector<RayHit> hits;
+	thread_local ViewCache cache;
+	thread_local FrameBuffer scaled{0, 0, std::vector<uint32_t>()}; // view rendered at view_columns before the upscale
+	if (!view_columns || view_columns > fb.w / 2) view_columns = fb.w / 2;
+	if (tables.w != view_columns || tables.fov != player.fov || tables.backend != backend) tables = ViewTables(view_columns, player.fov, backend);
+	tables.column_scale = view_columns / static_cast<float>(fb.w / 2);
+	if ((view_columns != fb.w / 2 || interleave) && history) history->valid = false; // the incremental path redraws full resolution columns
+	if (history && !aux && render_sprites_only(fb, *history, tables, map, player, sprites, texture_walls, texture_monsters, lightmap, pvs)) return;
+
+	fb.clear(pack_color(255, 255, 255)); // clear the screen
+	
+	const size_t rect_w = fb.w / (map.w * 2);
+	const size_t rect_h = fb.h / map.h;
+	for (size_t j = 0; j < map.h; j++) {
+		for (size_t i = 0; i < map.w; i++) {
+			if (map.is_empty(i, j) || (pvs && !pvs->visible_from(player.x, player.y, i, j))) continue;
+			size_t rect_x = i * rect_w;
+			size_t rect_y = j * rect_h;
+			size_t texture_id = map.get(i, j);
+			assert(texture_id < texture_walls.count);
+			const int door = map.door(i, j);
+			if (door >= 0) { // the closed part of the panel, a quarter of the cell thick
+				const Door& panel = map.doors[door];
+				const size_t closed_w = rect_w * (1 - panel.open), closed_h = rect_h * (1 - panel.open);
+				if (panel.vertical) {
+					fb.draw_rect(rect_x + rect_w * 3 / 8, rect_y + rect_h - closed_h, rect_w / 4, closed_h, texture_walls.get(0, 0, texture_id));
+				} else {
+					fb.draw_rect(rect_x + rect_w - closed_w, rect_y + rect_h * 3 / 8, closed_w, rect_h / 4, texture_walls.get(0, 0, texture_id));
+				}
+				continue;
+			}
+			fb.draw_rect(rect_x, rect_y, rect_w, rect_h, texture_walls.get(0, 0, texture_id));
+		}
+	}
+
+	if (aux) {
+		aux->w = tables.w;
+		aux->h = fb.h;
+		aux->clear();
+	}
+	if (view_columns == fb.w / 2) {
+		if (interleave) {
+			cache.valid = false; // hits now holds filled columns
+			render_interleaved(fb, fb.w / 2, tables, hits, map, player, sprites, texture_walls, texture_monsters, lightmap, aux, pvs, *interleave);
+		} else {
+			render_view(fb, fb.w / 2, tables, hits, map, player, sprites, texture_walls, texture_monsters, lightmap, aux, &cache, pvs);
+		}
+	} else {
+		scaled.w = view_columns;
+		scaled.h = fb.h;
+		scaled.clear(pack_color(255, 255, 255));
+		if (interleave) {
+			cache.valid = false;
+			render_interleaved(scaled, 0, tables, hits, map, player, sprites, texture_walls, texture_monsters, lightmap, aux, pvs, *interleave);
+		} else {
+			render_view(scaled, 0, tables, hits, map, player, sprites, texture_walls, texture_monsters, lightmap, aux, &cache, pvs);
+		}
+		PROFILE_SCOPE("upscale");
+		size_t* source = frame_arena().alloc<size_t>(fb.w / 2); // nearest scaled column of every view column
+		for (size_t x = 0; x < fb.w / 2; x++) {
+			source[x] = x * view_columns / (fb.w / 2);
+		}
+		for (size_t y = 0; y < fb.h; y++) {
+			const uint32_t* row = &scaled.img[y * view_columns];
+			uint32_t* out = &fb.img[fb.w / 2 + y * fb.w];
+			for (size_t x = 0; x < fb.w / 2; x++) {
+				out[x] = row[source[x]];
+			}
+		}
+	}
+
+	PROFILE_SCOPE("map");
+	for (size_t i = 0; i < hits.size(); i++) { // visibility cone on the map
+		float angle = player.a - player.fov / 2 + player.fov * i / static_cast<float>(tables.w);
+		float ray_x = cos(angle), ray_y = sin(angle);
+		if (backend == RAY_FIXED) {
+			int32_t c, s;
+			fixed_sincos(to_binary_angle(player.a) + tables.angle_offset[i], c, s);
+			ray_x = c / static_cast<float>(1 << FIXED_DIR_SHIFT);
+			ray_y = s / static_cast<float>(1 << FIXED_DIR_SHIFT);
+		}
+		for (float t = 0; t < hits[i].dist; t += 0.01) {
+			fb.set_pixel((player.x + t * ray_x) * rect_w, (player.y + t * ray_y) * rect_h, pack_color(160, 160, 160));
+		}
+	}
+
+	if (history && view_columns == fb.w / 2 && !interleave) { // a stretched or interleaved view stays invalid, see above
+		history->valid = true;
+		history->player = player;
+		history->w = fb.w;
+		history->h = fb.h;
+		history->map = &map;
+		history->map_version = map.version;
+		history->door_version = map.door_version;
+		history->lightmap = lightmap;
+		history->backend = backend;
+		history->pvs = pvs;
+		history->sprites = sprites;
+		history->minimap.resize(fb.w / 2 * fb.h);
+		for (size_t y = 0; y < fb.h; y++) {
+			std::copy(&fb.img[y * fb.w], &fb.img[y * fb.w] + fb.w / 2, &history->minimap[y * fb.w / 2]);
+		}
+	}
+	for (size_t i = 0; i < sprites.size(); i++) {
+		if (!sprite_visible(pvs, player, sprites, i)) continue;
+		map_show_sprite(sprites.get(i), fb, map);
+	}
+}
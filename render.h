@@ -0,0 +1,136 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <cstdlib>
+#include <vector>
+
+#include "map.h"
+#include "player.h"
+#include "sprite.h"
+#include "textures.h"
+#include "raycast.h"
+#include "lightmap.h"
+#include "framebuffer.h"
+#include "pvs.h"
+
+typedef struct ViewTables {
+	size_t w;			// number of view columns
+	float fov;			// field of view the tables were built for
+	size_t first, view_w;		// a slice covers the columns [first, first + w) of a view view_w columns wide
+	float column_scale;		// view columns per output column, below 1 for a view rendered narrower then stretched
+	RayBackend backend;		// how the views using these tables are cast and projected
+	std::vector<float> cos_offset;	// cos/sin of the angle between column i and the view direction,
+	std::vector<float> sin_offset;	// shared by every player with the same fov and view width
+	std::vector<uint32_t> angle_offset;	// RAY_FIXED only: binary angle of column i relative to the view direction
+	std::vector<int32_t> fixed_cos_offset;	// and its 2.30 cosine, cos/sin_offset are then converted from the fixed point values
+
+	ViewTables(const size_t w, const float fov, const RayBackend backend = RAY_FLOAT);
+	void slice(const ViewTables& view, const size_t begin, const size_t end); // make these tables the columns [begin, end) of view
+	void interleave(const ViewTables& view, const size_t phase); // make these tables the columns phase, phase + 2, ... of view
+} ViewTables;
+
+// Pose the hits of a view were cast for. When the next frame only rotates the camera by a whole
+// number of columns (within tolerance, in columns) the hits are shifted and only the newly exposed
+// columns are cast, along with the kept columns whose ray crosses cells edited or doors moved since
+// (Map::changes_since, Map::doors_moved_since); any other change (position, fov, width, map) casts every
+// column again.
+typedef struct ViewCache {
+	bool valid;
+	float x, y, a, fov;
+	size_t w;
+	const Map* map;
+	uint64_t map_version, door_version;
+	float tolerance;
+	size_t reused, cast;	// columns reused and cast by the last frame
+
+	ViewCache(const float tolerance = 1e-3);
+} ViewCache;
+
+int wall_x_texture_coord(const float offset, Texture &texture_walls); // texture column of a wall hit at RayHit::offset
+void cast_view(Map& map, Player& player, const ViewTables& tables, std::vector<RayHit>& hits, ViewCache* cache = nullptr); // one ray per view column
+void map_show_sprite(const Sprite& sprite, FrameBuffer &fb, Map& map);
+
+const float SPRITE_NEAR = 1e-2f;	// sprites closer to the camera plane, or behind it, are projected with size 0
+
+// Camera space of the sprites of a SpriteSet for one view, in arrays from the thread's frame_arena()
+typedef struct SpriteProjection {
+	size_t n;
+	float* angle;		// direction of the sprite relative to the view direction, in [-pi, pi]
+	float* dist;		// euclidean distance from the player
+	float* depth;		// distance from the camera plane, as for the walls
+	int* h_offset, * v_offset, * size;	// screen square [h_offset, h_offset + size) x [v_offset, v_offset + size), empty when culled
+	size_t* tile;		// texture tile drawn, texture_id plus the rotation bucket the sprite is seen from
+} SpriteProjection;
+
+// project every sprite into a view_w x view_h view at once, 4 at a time with SSE2 (and a polynomial atan2);
+// RAY_FIXED takes the view direction from fixed_sincos() like its rays
+void project_sprites(const SpriteSet& sprites, const Player& player, const size_t view_w, const size_t view_h, SpriteProjection& projection, const RayBackend backend = RAY_FLOAT);
+// the same projection for a single sprite
+void project_sprite(const Sprite& sprite, const Player& player, const size_t view_w, const size_t view_h, int& h_offset, int& v_offset, int& size, float& depth, const RayBackend backend = RAY_FLOAT);
+
+// The view passes are instantiated for FrameBuffer (RGBA32 textures) and FrameBuffer8, the latter
+// samples the texture img8 copies and writes pixels in their format8 (see Texture::convert).
+// Shaded textures (Texture::shade) are darkened or fogged by distance according to Map::fog_distance
+// and, when a lightmap is given, by its baked light.
+template <typename T> void draw_walls(FrameBufferT<T>& fb, const size_t view_x, const ViewTables& tables, const std::vector<RayHit>& hits, Map& map, Texture& texture_walls, const Lightmap* lightmap = nullptr, AuxBuffers* aux = nullptr);
+// floor and ceiling of the map, one row at a time, skipping the pixels covered by the walls of hits
+template <typename T> void draw_floor(FrameBufferT<T>& fb, const size_t view_x, const ViewTables& tables, const std::vector<RayHit>& hits, Map& map, Player& player, Texture& texture_walls, const Lightmap* lightmap = nullptr, AuxBuffers* aux = nullptr);
+// sprite sprite_index of sprites, projected for the tables.view_w x fb.h view
+template <typename T> void draw_sprite(const SpriteSet& sprites, const SpriteProjection& projection, const size_t sprite_index, FrameBufferT<T>& fb, const size_t view_x, const ViewTables& tables, Map& map, Texture& texture_sprites, const Lightmap* lightmap = nullptr, AuxBuffers* aux = nullptr);
+// draw the first person view into the columns [view_x, view_x + tables.w) of fb, hits is caller owned scratch
+// (kept between frames by the caller), all other scratch memory comes from the thread's frame_arena();
+// aux, if given, must be tables.w x fb.h and cleared, it receives the depth and label of every drawn pixel;
+// with a pvs the sprites in cells not visible from the player's cell are skipped
+template <typename T> void render_view(FrameBufferT<T>& fb, const size_t view_x, const ViewTables& tables, std::vector<RayHit>& hits, Map& map, Player& player, const SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, const Lightmap* lightmap = nullptr, AuxBuffers* aux = nullptr, ViewCache* cache = nullptr, const PVS* pvs = nullptr);
+
+// What render() last drew into a FrameBuffer. When the next call only moves sprites (same camera,
+// map and door versions, lightmap and frame size, no aux) it redraws the view columns and the map
+// rectangles the sprites left or entered and marks only the screen rectangles of those sprites and
+// markers dirty; anything else falls back to a full frame.
+typedef struct FrameHistory {
+	bool valid;
+	Player player;
+	size_t w, h;
+	const Map* map;
+	uint64_t map_version, door_version;
+	const Lightmap* lightmap;
+	RayBackend backend;
+	const PVS* pvs;
+	SpriteSet sprites;
+	std::vector<uint32_t> minimap;	// left half of the frame before the sprite markers
+
+	FrameHistory();
+} FrameHistory;
+
+// State of the interleaved view mode: each frame casts only every other column, alternating the
+// phase, and fills the others from the previous frame when the camera only turned by a whole number
+// of columns and the map, doors, lightmap and PVS did not change (columns that were themselves
+// filled are not reused, so errors do not build up, and the columns of the sprites that moved are
+// cast again) and by averaging their two cast neighbours otherwise.
+typedef struct Interleave {
+	bool valid;
+	size_t phase;			// parity of the columns cast by the last frame
+	Player player;
+	size_t w, h;
+	const Map* map;
+	uint64_t map_version, door_version;
+	const Lightmap* lightmap;
+	RayBackend backend;
+	const PVS* pvs;
+	SpriteSet sprites;		// as last drawn
+	std::vector<uint32_t> view;	// last view, w x h
+	std::vector<bool> cast;		// columns of view that were cast rather than filled
+	float tolerance;		// in columns, as ViewCache::tolerance
+	size_t reused, interpolated;	// columns filled from the previous frame and from neighbours by the last frame
+
+	Interleave(const float tolerance = 1e-3);
+} Interleave;
+
+// map on the left half of fb, first person view on the right half (and in aux, resized and cleared here),
+// RAY_FIXED casts and projects the walls, floor and map cone in fixed point for bit exact frames;
+// view_columns (0 for all fb.w / 2) renders a narrower view stretched over the right half, interleave casts
+// every other of these columns only; aux then has as many columns as were cast. With a pvs the map only shows
+// the walls and sprites in cells visible from the player's cell and the view skips the hidden sprites.
+void render(FrameBuffer& fb, Map& map, Player& player, const SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, const Lightmap* lightmap = nullptr, AuxBuffers* aux = nullptr, FrameHistory* history = nullptr, const RayBackend backend = RAY_FLOAT, size_t view_columns = 0, Interleave* interleave = nullptr, const PVS* pvs = nullptr);
+
+#endif
@@ -0,0 +1,42 @@
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+#include "resolution.h"
+
+double ResolutionStats::mean_scale() const {
+	return frames ? scale_sum / frames : 1;
+}
+
+ResolutionScaler::ResolutionScaler(const float budget_ms) : budget_ms(budget_ms), levels{1, .875, .75, .625, .5, .375, .25}, level(0), smoothed_ms(0), down_frames(3), up_frames(15), headroom(.85), down_streak(0), up_streak(0), stats{0, 0, 0, std::vector<size_t>(levels.size()), 0} {
+	assert(budget_ms > 0);
+}
+
+float ResolutionScaler::scale() const {
+	return levels[level];
+}
+
+size_t ResolutionScaler::columns(const size_t view_w) const {
+	return std::max(static_cast<size_t>(1), static_cast<size_t>(view_w * scale() + .5f));
+}
+
+void ResolutionScaler::update(const float frame_ms) {
+	stats.frames++;
+	stats.over_budget += frame_ms > budget_ms;
+	stats.frames_at[level]++;
+	stats.scale_sum += scale();
+	smoothed_ms = smoothed_ms ? .8f * smoothed_ms + .2f * frame_ms : frame_ms;
+
+	// the view cost is taken as proportional to the number of columns
+	const bool over = smoothed_ms > budget_ms && level + 1 < levels.size();
+	const bool under = level > 0 && smoothed_ms * levels[level - 1] / levels[level] < headroom * budget_ms;
+	down_streak = over ? down_streak + 1 : 0;
+	up_streak = under ? up_streak + 1 : 0;
+	if (down_streak < down_frames && up_streak < up_frames) return;
+
+	const size_t next = down_streak >= down_frames ? level + 1 : level - 1;
+	smoothed_ms *= levels[next] / levels[level]; // expected time at the new level, keeps the next decision from using stale times
+	level = next;
+	down_streak = up_streak = 0;
+	stats.changes++;
+}
@@ -0,0 +1,37 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include <cstdlib>
+#include <vector>
+
+typedef struct ResolutionStats {
+	size_t frames;			// frames measured by update()
+	size_t over_budget;		// frames that took longer than the budget
+	size_t changes;			// number of scale changes
+	std::vector<size_t> frames_at;	// frames rendered at each level of ResolutionScaler::levels
+	double scale_sum;		// sum of the scales of all frames, see mean_scale()
+
+	double mean_scale() const;
+} ResolutionStats;
+
+// Picks the fraction of the view columns to render so that frames stay within budget_ms. The frame
+// time is smoothed, the scale drops one level after down_frames consecutive frames over budget and
+// rises one level after up_frames consecutive frames whose time scaled to the higher level would
+// still leave headroom below the budget, so that it does not oscillate between two levels.
+typedef struct ResolutionScaler {
+	float budget_ms;
+	std::vector<float> levels;	// column fractions, from full resolution down
+	size_t level;			// current index in levels
+	float smoothed_ms;		// exponential moving average of the frame time, 0 before the first frame
+	size_t down_frames, up_frames;
+	float headroom;			// fraction of the budget a frame predicted at the higher level must stay under
+	size_t down_streak, up_streak;
+	ResolutionStats stats;
+
+	ResolutionScaler(const float budget_ms);
+	float scale() const;
+	size_t columns(const size_t view_w) const; // columns to render for a view_w columns wide view
+	void update(const float frame_ms); // frame time of the last frame, rendered at scale()
+} ResolutionScaler;
+
+#endif
@@ -0,0 +1,148 @@
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <cassert>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "shmring.h"
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring needs address free 64-bit atomics");
+static_assert(sizeof(RingHeader) == 64 && sizeof(RingSlot) == 64, "ring layout");
+
+static size_t ring_size(const size_t w, const size_t h, const size_t nslots) {
+	return sizeof(RingHeader) + nslots * sizeof(RingSlot) + nslots * w * h * sizeof(uint32_t);
+}
+
+uint64_t ring_clock() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameRing::FrameRing(const std::string name, const size_t w, const size_t h, const size_t nslots) : name(name), size(ring_size(w, h, nslots)), base(nullptr), owner(true), header(nullptr), slots(nullptr), pixels(nullptr), recent(nslots), rects() {
+	assert(nslots > 0);
+	shm_unlink(name.c_str());
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0 || ftruncate(fd, size) < 0 || (base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		std::cerr << "Error: can not create the shared memory ring " << name << std::endl;
+		if (fd >= 0) close(fd);
+		base = nullptr;
+		return;
+	}
+	close(fd);
+	header = new (base) RingHeader(); // zero filled by ftruncate, construct the atomics in place
+	slots = reinterpret_cast<RingSlot*>(header + 1);
+	for (size_t i = 0; i < nslots; i++) {
+		new (slots + i) RingSlot();
+	}
+	pixels = reinterpret_cast<uint32_t*>(slots + nslots);
+	header->w = w;
+	header->h = h;
+	header->slots = nslots;
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(header->magic, "TRCRING1", 8); // readers check the magic last
+}
+
+FrameRing::FrameRing(const std::string name) : name(name), size(0), base(nullptr), owner(false), header(nullptr), slots(nullptr), pixels(nullptr), recent(), rects() {
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(RingHeader) || (base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		if (fd >= 0) close(fd);
+		base = nullptr;
+		return;
+	}
+	close(fd);
+	size = st.st_size;
+	header = static_cast<RingHeader*>(base);
+	if (memcmp(header->magic, "TRCRING1", 8) || !header->slots || ring_size(header->w, header->h, header->slots) > size) {
+		munmap(base, size);
+		base = nullptr;
+		header = nullptr;
+		return;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	slots = reinterpret_cast<RingSlot*>(header + 1);
+	pixels = reinterpret_cast<uint32_t*>(slots + header->slots);
+}
+
+FrameRing::~FrameRing() {
+	if (!base) return;
+	if (owner) {
+		header->closed.store(1, std::memory_order_release);
+		shm_unlink(name.c_str());
+	}
+	munmap(base, size);
+}
+
+bool FrameRing::is_open() const {
+	return base != nullptr;
+}
+
+uint64_t FrameRing::publish(const std::vector<uint32_t>& image) {
+	assert(owner && base && image.size() == header->w * header->h);
+	rects.assign(1, Rect{0, 0, header->w, header->h});
+	const uint64_t frame = publish(image.data(), rects);
+	recent[frame % header->slots] = rects;
+	return frame;
+}
+
+uint64_t FrameRing::publish(const FrameBuffer& fb) {
+	assert(owner && base && fb.w == header->w && fb.h == header->h);
+	const uint64_t frame = header->head.load(std::memory_order_relaxed) + 1;
+	fb.changed(rects);
+	// the slot still holds frame - slots, so what changed since then is the union of the regions
+	// of the frames after it; slots not written yet get the whole frame
+	bool full = frame <= header->slots || fb.all_dirty;
+	for (uint64_t f = frame - header->slots + 1; !full && f < frame; f++) {
+		const std::vector<Rect>& past = recent[f % header->slots];
+		full = past.size() == 1 && past[0].w == header->w && past[0].h == header->h;
+		rects.insert(rects.end(), past.begin(), past.end());
+	}
+	if (full) rects.assign(1, Rect{0, 0, header->w, header->h});
+	publish(fb.img.data(), rects);
+	fb.changed(recent[frame % header->slots]);
+	return frame;
+}
+
+uint64_t FrameRing::publish(const uint32_t* image, const std::vector<Rect>& copy) {
+	const size_t w = header->w, h = header->h;
+	const uint64_t frame = header->head.load(std::memory_order_relaxed) + 1;
+	RingSlot& slot = slots[frame % header->slots];
+	uint32_t* dst = pixels + frame % header->slots * w * h;
+	slot.seq.store(2 * frame - 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release); // readers seeing the new pixels see the odd sequence
+	for (size_t r = 0; r < copy.size(); r++) {
+		if (copy[r].w == w) { // whole rows are contiguous
+			memcpy(dst + copy[r].y * w, image + copy[r].y * w, copy[r].h * w * sizeof(uint32_t));
+			continue;
+		}
+		for (size_t y = copy[r].y; y < copy[r].y + copy[r].h; y++) {
+			memcpy(dst + y * w + copy[r].x, image + y * w + copy[r].x, copy[r].w * sizeof(uint32_t));
+		}
+	}
+	slot.timestamp = ring_clock();
+	slot.seq.store(2 * frame, std::memory_order_release);
+	header->head.store(frame, std::memory_order_release);
+	return frame;
+}
+
+uint64_t FrameRing::latest() const {
+	return header->head.load(std::memory_order_acquire);
+}
+
+const uint32_t* FrameRing::acquire(const uint64_t frame, uint64_t& timestamp) const {
+	const RingSlot& slot = slots[frame % header->slots];
+	if (!frame || slot.seq.load(std::memory_order_acquire) != 2 * frame) return nullptr;
+	timestamp = slot.timestamp;
+	return still_valid(frame) ? pixels + frame % header->slots * header->w * header->h : nullptr;
+}
+
+bool FrameRing::still_valid(const uint64_t frame) const {
+	std::atomic_thread_fence(std::memory_order_acquire); // the reads of the frame happen before the check
+	return slots[frame % header->slots].seq.load(std::memory_order_relaxed) == 2 * frame;
+}
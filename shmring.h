@@ -0,0 +1,56 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include "framebuffer.h"
+
+// Frame ring in POSIX shared memory: a header, one RingSlot per slot, then the packed RGBA
+// pixels of every slot. Frames are numbered from 1, frame n lives in slot n % slots. The
+// renderer is the only writer: it sets the slot sequence to 2n - 1, writes the pixels, sets it
+// to 2n and then head to n. Readers map the pixels in place and check the sequence before and
+// after using them (seqlock), a frame that changed meanwhile was overwritten by a lapping writer.
+typedef struct RingSlot {
+	std::atomic<uint64_t> seq;	// 2n once frame n is complete, odd while being written
+	uint64_t timestamp;		// steady_clock nanoseconds at which the frame was published
+	char pad[48];			// one cache line per slot
+} RingSlot;
+
+typedef struct RingHeader {
+	char magic[8];			// "TRCRING1"
+	uint32_t w, h, slots;
+	std::atomic<uint32_t> closed;	// set when the writer goes away
+	std::atomic<uint64_t> head;	// last complete frame, 0 before the first
+	char pad[32];
+} RingHeader;
+
+typedef struct FrameRing {
+	std::string name;
+	size_t size;			// of the mapping
+	void* base;			// nullptr if the ring could not be created or opened
+	bool owner;			// the writer unlinks the ring when destroyed
+	RingHeader* header;
+	RingSlot* slots;
+	uint32_t* pixels;
+	std::vector<std::vector<Rect> > recent;	// writer: dirty regions of the frame last published in each slot
+	std::vector<Rect> rects;		// scratch
+
+	FrameRing(const std::string name, const size_t w, const size_t h, const size_t nslots); // create (or replace) a ring to write to
+	FrameRing(const std::string name); // open an existing ring read-only
+	~FrameRing();
+	bool is_open() const;
+	uint64_t publish(const std::vector<uint32_t>& image); // returns the frame number
+	uint64_t publish(const FrameBuffer& fb); // copies only what changed since the frame the slot holds
+	uint64_t publish(const uint32_t* image, const std::vector<Rect>& copy); // writes only the copy regions to the next slot
+	uint64_t latest() const;
+	const uint32_t* acquire(const uint64_t frame, uint64_t& timestamp) const; // nullptr if frame is not complete or already overwritten
+	bool still_valid(const uint64_t frame) const; // frame was not overwritten since acquire()
+} FrameRing;
+
+uint64_t ring_clock(); // time base of RingSlot::timestamp
+
+#endif
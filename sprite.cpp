@@ -0,0 +1,72 @@
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+#include "sprite.h"
+
+SpriteAtlas::SpriteAtlas(const size_t tiles) : tiles(tiles), sequences() {
+	for (size_t i = 0; i < tiles; i++) {
+		add(i, 1);
+	}
+}
+
+uint32_t SpriteAtlas::add(const uint32_t first, const uint32_t frames, const uint32_t rotations, const float frame_time) {
+	assert(frames > 0 && rotations > 0 && frame_time > 0 && first + frames * rotations <= tiles);
+	sequences.push_back(SpriteSequence{first, frames, rotations, frame_time});
+	return sequences.size() - 1;
+}
+
+SpriteSet::SpriteSet() : x(), y(), texture_id(), sequence(), time(), facing(), rotations() {
+}
+
+SpriteSet::SpriteSet(const std::vector<Sprite>& sprites) : SpriteSet() {
+	for (size_t i = 0; i < sprites.size(); i++) {
+		add(sprites[i]);
+	}
+}
+
+size_t SpriteSet::size() const {
+	return x.size();
+}
+
+void SpriteSet::add(const Sprite& sprite) {
+	add(sprite.x, sprite.y, sprite.texture_id);
+	texture_id.back() = sprite.texture_id;
+}
+
+void SpriteSet::add(const float x, const float y, const uint32_t sequence, const float time, const float facing) {
+	this->x.push_back(x);
+	this->y.push_back(y);
+	texture_id.push_back(0); // resolved by animate_sprites()
+	this->sequence.push_back(sequence);
+	this->time.push_back(time);
+	this->facing.push_back(facing);
+	rotations.push_back(1);
+}
+
+Sprite SpriteSet::get(const size_t i) const {
+	assert(i < size());
+	return Sprite{x[i], y[i], texture_id[i]};
+}
+
+void SpriteSet::set(const size_t i, const Sprite& sprite) {
+	assert(i < size());
+	x[i] = sprite.x;
+	y[i] = sprite.y;
+	texture_id[i] = sprite.texture_id;
+}
+
+void animate_sprites(SpriteSet& sprites, const SpriteAtlas& atlas, const float dt) {
+	const SpriteSequence* sequences = atlas.sequences.data();
+	for (size_t i = 0; i < sprites.size(); i++) {
+		assert(sprites.sequence[i] < atlas.sequences.size());
+		const SpriteSequence& s = sequences[sprites.sequence[i]];
+		const float length = s.frames * s.frame_time;
+		float t = sprites.time[i] + dt;
+		t -= length * std::floor(t / length); // looped, in [0, length)
+		const uint32_t frame = std::min(static_cast<uint32_t>(t / s.frame_time), s.frames - 1);
+		sprites.time[i] = t;
+		sprites.texture_id[i] = s.first + frame * s.rotations;
+		sprites.rotations[i] = s.rotations;
+	}
+}
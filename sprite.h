@@ -2,10 +2,54 @@
 #define SPRITE_H
 
 #include <cstdlib>
+#include <cstdint>
+#include <vector>
 
 struct Sprite {
 	float x, y;
 	size_t texture_id;
 };
 
+// Animations over the square tiles of a sprite texture. A sequence has frames x rotations tiles starting
+// at first: tile first + frame * rotations + r shows frame seen from rotation bucket r (bucket 0 faces
+// the viewer, the others follow counterclockwise). Sequences [0, tiles) are the still tiles themselves.
+typedef struct SpriteSequence {
+	uint32_t first;		// first tile
+	uint32_t frames;	// animation frames, looped
+	uint32_t rotations;	// views around the sprite, 1 for a sprite that looks the same from everywhere
+	float frame_time;	// seconds per frame
+} SpriteSequence;
+
+typedef struct SpriteAtlas {
+	size_t tiles;
+	std::vector<SpriteSequence> sequences;
+
+	SpriteAtlas(const size_t tiles); // with the still sequence of every tile
+	uint32_t add(const uint32_t first, const uint32_t frames, const uint32_t rotations = 1, const float frame_time = .1); // new sequence id
+} SpriteAtlas;
+
+// Sprites stored as separate arrays (structure of arrays), so that the camera transform of all of
+// them is one pass over contiguous floats (see project_sprites()); sprite i is x[i], y[i], texture_id[i].
+// texture_id is the tile of the current animation frame seen from the front, animate_sprites() sets it
+// and rotations, the rotation bucket is added by project_sprites() since it depends on the view.
+typedef struct SpriteSet {
+	std::vector<float> x, y;
+	std::vector<size_t> texture_id;
+	std::vector<uint32_t> sequence;	// SpriteAtlas sequence played, the still tile texture_id for added Sprites
+	std::vector<float> time;	// seconds into the sequence
+	std::vector<float> facing;	// direction the sprite faces, in radians
+	std::vector<uint32_t> rotations;	// of the sequence
+
+	SpriteSet();
+	SpriteSet(const std::vector<Sprite>& sprites);
+	size_t size() const;
+	void add(const Sprite& sprite);
+	void add(const float x, const float y, const uint32_t sequence, const float time = 0, const float facing = 0);
+	Sprite get(const size_t i) const;
+	void set(const size_t i, const Sprite& sprite);
+} SpriteSet;
+
+// advance the animation of every sprite by dt and resolve its current tile, in one pass without branches
+void animate_sprites(SpriteSet& sprites, const SpriteAtlas& atlas, const float dt);
+
 #endif
@@ -0,0 +1,246 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+#include "stream.h"
+
+enum { FRAME_KEY = 0, FRAME_DELTA = 1 };
+
+static void put_le(std::ofstream& ofs, const uint64_t value, const size_t bytes) {
+	for (size_t i = 0; i < bytes; i++) {
+		ofs.put(static_cast<char>((value >> (8 * i)) & 255));
+	}
+}
+
+static uint64_t get_le(std::ifstream& ifs, const size_t bytes) {
+	uint64_t value = 0;
+	for (size_t i = 0; i < bytes; i++) {
+		value |= static_cast<uint64_t>(static_cast<uint8_t>(ifs.get())) << (8 * i);
+	}
+	return value;
+}
+
+static void put_varint(std::vector<uint8_t>& out, size_t value) {
+	while (value >= 128) {
+		out.push_back((value & 127) | 128);
+		value >>= 7;
+	}
+	out.push_back(value);
+}
+
+static void put_word(std::vector<uint8_t>& out, const uint32_t word) {
+	for (size_t i = 0; i < 4; i++) {
+		out.push_back((word >> (8 * i)) & 255);
+	}
+}
+
+// runs of at least 3 equal words, literals for the rest
+static void encode(const uint32_t* words, const size_t n, std::vector<uint8_t>& out) {
+	size_t i = 0, literal = 0; // literal = start of the pending literal words
+	while (i < n) {
+		size_t run = 1;
+		while (i + run < n && words[i + run] == words[i]) run++;
+		if (run < 3) {
+			i += run;
+			continue;
+		}
+		if (literal < i) {
+			put_varint(out, (i - literal) << 1 | 1);
+			for (size_t k = literal; k < i; k++) put_word(out, words[k]);
+		}
+		put_varint(out, run << 1);
+		put_word(out, words[i]);
+		i += run;
+		literal = i;
+	}
+	if (literal < n) {
+		put_varint(out, (n - literal) << 1 | 1);
+		for (size_t k = literal; k < n; k++) put_word(out, words[k]);
+	}
+}
+
+// key frames are written over out, delta frames XORed into it
+static bool decode(const std::vector<uint8_t>& in, const bool delta, std::vector<uint32_t>& out) {
+	size_t pos = 0, i = 0;
+	while (pos < in.size()) {
+		size_t token = 0;
+		for (int shift = 0; pos < in.size(); shift += 7) {
+			uint8_t byte = in[pos++];
+			token |= static_cast<size_t>(byte & 127) << shift;
+			if (!(byte & 128)) break;
+		}
+		const size_t n = token >> 1;
+		const bool literal = token & 1;
+		if (i + n > out.size() || pos + (literal ? n : 1) * 4 > in.size()) return false;
+		for (size_t k = 0; k < n; k++) {
+			const uint8_t* p = &in[pos + (literal ? k : 0) * 4];
+			uint32_t word = p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+			out[i + k] = delta ? out[i + k] ^ word : word;
+		}
+		pos += (literal ? n : 1) * 4;
+		i += n;
+	}
+	return i == out.size();
+}
+
+StreamWriter::StreamWriter(const std::string filename, const size_t w, const size_t h, const size_t keyframe_interval) : ofs(filename, std::ios::binary), w(w), h(h), keyframe_interval(keyframe_interval ? keyframe_interval : 1), previous(), offsets(), payload(), delta(), rects() {
+	if (!ofs.is_open()) {
+		std::cerr << "Error: can not create the sequence file " << filename << std::endl;
+		return;
+	}
+	ofs << "TRCSEQ01";
+	put_le(ofs, w, 4);
+	put_le(ofs, h, 4);
+	put_le(ofs, this->keyframe_interval, 4);
+}
+
+StreamWriter::~StreamWriter() {
+	close();
+}
+
+bool StreamWriter::is_open() const {
+	return ofs.is_open();
+}
+
+void StreamWriter::write(const std::vector<uint32_t>& image) {
+	assert(image.size() == w * h);
+	if (!ofs.is_open()) return;
+	const bool key = offsets.size() % keyframe_interval == 0;
+	payload.clear();
+	if (key) {
+		encode(image.data(), image.size(), payload);
+		previous = image;
+	} else {
+		for (size_t i = 0; i < image.size(); i++) { // XOR in place, previous becomes the delta then the new frame
+			previous[i] ^= image[i];
+		}
+		encode(previous.data(), previous.size(), payload);
+		previous = image;
+	}
+	put_record(key);
+}
+
+void StreamWriter::write(const FrameBuffer& fb) {
+	assert(fb.w == w && fb.h == h);
+	if (offsets.size() % keyframe_interval == 0 || fb.all_dirty) {
+		write(fb.img);
+		return;
+	}
+	if (!ofs.is_open()) return;
+	delta.resize(w * h, 0);
+	fb.changed(rects);
+	for (size_t r = 0; r < rects.size(); r++) { // the delta is zero outside the dirty regions
+		for (size_t y = rects[r].y; y < rects[r].y + rects[r].h; y++) {
+			for (size_t i = y * w + rects[r].x; i < y * w + rects[r].x + rects[r].w; i++) {
+				delta[i] ^= previous[i] ^ fb.img[i]; // overlapping regions see previous already updated
+				previous[i] = fb.img[i];
+			}
+		}
+	}
+	payload.clear();
+	encode(delta.data(), delta.size(), payload);
+	for (size_t r = 0; r < rects.size(); r++) {
+		for (size_t y = rects[r].y; y < rects[r].y + rects[r].h; y++) {
+			std::fill(delta.begin() + y * w + rects[r].x, delta.begin() + y * w + rects[r].x + rects[r].w, 0);
+		}
+	}
+	put_record(false);
+}
+
+void StreamWriter::put_record(const bool key) {
+	offsets.push_back(ofs.tellp());
+	ofs.put(key ? FRAME_KEY : FRAME_DELTA);
+	put_le(ofs, payload.size(), 4);
+	ofs.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+}
+
+void StreamWriter::close() {
+	if (!ofs.is_open()) return;
+	for (size_t i = 0; i < offsets.size(); i++) {
+		put_le(ofs, offsets[i], 8);
+	}
+	put_le(ofs, offsets.size(), 4);
+	ofs << "TRCIDX01";
+	ofs.close();
+}
+
+StreamReader::StreamReader(const std::string filename) : ifs(filename, std::ios::binary), w(0), h(0), keyframe_interval(0), end(0), offsets(), current(), current_index(-1), payload() {
+	char magic[8];
+	if (!ifs.read(magic, 8) || memcmp(magic, "TRCSEQ01", 8)) return;
+	w = get_le(ifs, 4);
+	h = get_le(ifs, 4);
+	keyframe_interval = get_le(ifs, 4);
+	if (!ifs || !w || !h || !keyframe_interval) {
+		keyframe_interval = 0;
+		return;
+	}
+	ifs.seekg(0, std::ios::end);
+	const uint64_t file_size = ifs.tellg();
+
+	ifs.seekg(-12, std::ios::end); // index footer
+	const uint64_t count = get_le(ifs, 4);
+	if (file_size < 32 || !ifs.read(magic, 8) || memcmp(magic, "TRCIDX01", 8)) { // not closed, walk the records
+		ifs.clear();
+		end = file_size;
+		ifs.seekg(20);
+		for (;;) {
+			uint64_t offset = ifs.tellg();
+			ifs.get();
+			uint64_t size = get_le(ifs, 4);
+			if (!ifs || offset + 5 + size > end) break;
+			offsets.push_back(offset);
+			if (offset + 5 + size == end) break;
+			ifs.seekg(size, std::ios::cur);
+		}
+		ifs.clear();
+		return;
+	}
+	if (count > (file_size - 32) / 8) return; // the index does not fit in the file
+	end = file_size - 12 - 8 * count;
+	ifs.seekg(end);
+	offsets.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		offsets[i] = get_le(ifs, 8);
+		if (!ifs || offsets[i] < (i ? offsets[i - 1] + 5 : 20) || offsets[i] + 5 > end) { // records are in order and before the index
+			offsets.clear();
+			return;
+		}
+	}
+}
+
+size_t StreamReader::frames() const {
+	return offsets.size();
+}
+
+bool StreamReader::read(const size_t index, std::vector<uint32_t>& image) {
+	if (index >= offsets.size()) return false;
+	size_t start = index - index % keyframe_interval; // closest keyframe
+	if (current_index >= static_cast<long>(start) && current_index <= static_cast<long>(index)) {
+		start = current_index + 1; // continue from the frame decoded last
+	} else {
+		current.assign(w * h, 0);
+	}
+	for (size_t i = start; i <= index; i++) {
+		ifs.clear();
+		ifs.seekg(offsets[i]);
+		const int type = ifs.get();
+		const uint64_t size = get_le(ifs, 4);
+		if (offsets[i] + 5 + size > end) {
+			current_index = -1;
+			return false;
+		}
+		payload.resize(size);
+		ifs.read(reinterpret_cast<char*>(payload.data()), payload.size());
+		if (!ifs || (i == start && current_index + 1 != static_cast<long>(i) && type != FRAME_KEY) || !decode(payload, type == FRAME_DELTA, current)) {
+			current_index = -1;
+			return false;
+		}
+		current_index = i;
+	}
+	image = current;
+	return true;
+}
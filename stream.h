@@ -0,0 +1,49 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "framebuffer.h"
+
+// Frame sequence file: "TRCSEQ01", uint32 w, h and keyframe interval, then one record per frame
+// (uint8 type, uint32 payload size, payload) and at the end an index of uint64 record offsets,
+// uint32 frame count and "TRCIDX01", all little endian. Keyframes encode the packed colors, delta
+// frames their XOR with the previous frame, both as runs (varint n << 1, one word repeated n times)
+// and literals (varint n << 1 | 1, n words), so unchanged areas cost a few bytes.
+typedef struct StreamWriter {
+	std::ofstream ofs;
+	size_t w, h, keyframe_interval;
+	std::vector<uint32_t> previous;
+	std::vector<uint64_t> offsets;	// of every record, written as the index by close()
+	std::vector<uint8_t> payload;	// scratch
+	std::vector<uint32_t> delta;	// scratch, all zero between writes
+	std::vector<Rect> rects;	// scratch
+
+	StreamWriter(const std::string filename, const size_t w, const size_t h, const size_t keyframe_interval = 60); // reports a file it can not create
+	~StreamWriter();
+	bool is_open() const;	// writes do nothing if not
+	void write(const std::vector<uint32_t>& image);
+	void write(const FrameBuffer& fb);	// same records, delta frames only look at the dirty regions of fb
+	void close();
+	void put_record(const bool key);	// payload as the next frame
+} StreamWriter;
+
+typedef struct StreamReader {
+	std::ifstream ifs;
+	size_t w, h, keyframe_interval;
+	uint64_t end;			// of the records, where the index starts
+	std::vector<uint64_t> offsets;
+	std::vector<uint32_t> current;	// last decoded frame, makes sequential reads cheap
+	long current_index;		// -1 before the first read
+	std::vector<uint8_t> payload;	// scratch
+
+	StreamReader(const std::string filename);	// frames() is 0 if the file can not be read or its header or index is invalid
+	size_t frames() const;
+	bool read(const size_t index, std::vector<uint32_t>& image);	// decode from the closest keyframe (or the last frame read)
+} StreamReader;
+
+#endif
@@ -2,6 +2,7 @@
 #include <vector>
 #include <cstdint>
 #include <cassert>
+#include <algorithm>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -10,7 +11,7 @@
 #include "utils.h"
 #include "textures.h"
 
-Texture::Texture(const std::string filename) : img_w(0), img_h(0), count(0), size(0), img() {
+Texture::Texture(const std::string filename) : img_w(0), img_h(0), count(0), size(0), kernel_size(0), img(), format8(RGBA32), img8(), shade_levels(0), fog_color(0), shaded(), shaded8() {
 	int nchannels = -1, w, h;
 	unsigned char* pixmap = stbi_load(filename.c_str(), &w, &h, &nchannels, 0);
 	if (!pixmap) {
@@ -32,6 +33,7 @@ Texture::Texture(const std::string filename) : img_w(0), img_h(0), count(0), siz
 
 	count = w / h;
 	size = w / count;
+	kernel_size = size == 64 || size == 128 ? size : 0;
 	img_w = w;
 	img_h = h;
 
@@ -48,11 +50,60 @@ Texture::Texture(const std::string filename) : img_w(0), img_h(0), count(0), siz
 	stbi_image_free(pixmap);
 }
 
+void Texture::convert(const PixelFormat format) {
+	assert(format == GRAY8 || format == INDEXED8);
+	if (format8 == format) return;
+	img8 = std::vector<uint8_t>(img.size());
+	for (size_t i = 0; i < img.size(); i++) {
+		img8[i] = convert_color(img[i], format);
+	}
+	shaded8 = std::vector<uint8_t>(shaded.size());
+	for (size_t i = 0; i < shaded.size(); i++) {
+		shaded8[i] = convert_color(shaded[i], format);
+	}
+	format8 = format;
+}
+
+void Texture::shade(const size_t levels, const uint32_t fog) {
+	if (shade_levels == levels && fog_color == fog) return;
+	shade_levels = levels;
+	fog_color = fog;
+	shaded = std::vector<uint32_t>(levels * img.size());
+	for (size_t level = 0; level < levels; level++) {
+		float t = levels > 1 ? level / static_cast<float>(levels - 1) : 0;
+		for (size_t i = 0; i < img.size(); i++) {
+			shaded[level * img.size() + i] = blend_color(img[i], fog_color, t);
+		}
+	}
+	shaded8 = std::vector<uint8_t>();
+	if (format8 != RGBA32) {
+		shaded8 = std::vector<uint8_t>(shaded.size());
+		for (size_t i = 0; i < shaded.size(); i++) {
+			shaded8[i] = convert_color(shaded[i], format8);
+		}
+	}
+}
+
+const uint32_t* Texture::pixels(const size_t level) {
+	assert(level < std::max(shade_levels, static_cast<size_t>(1)));
+	return shade_levels ? &shaded[level * img.size()] : img.data();
+}
+
+const uint8_t* Texture::pixels8(const size_t level) {
+	assert(format8 != RGBA32 && level < std::max(shade_levels, static_cast<size_t>(1)));
+	return shade_levels ? &shaded8[level * img8.size()] : img8.data();
+}
+
 uint32_t& Texture::get(const size_t i, const size_t j, const size_t idx) {
 	assert(i < size && j < size && idx < count);
 	return img[i + idx * size + j * img_w];
 }
 
+uint8_t& Texture::get8(const size_t i, const size_t j, const size_t idx) {
+	assert(i < size && j < size && idx < count && format8 != RGBA32);
+	return img8[i + idx * size + j * img_w];
+}
+
 std::vector<uint32_t> Texture::get_scaled_column(const size_t texture_id, const size_t texture_coord, const size_t column_height) {
 	assert(texture_coord < size && texture_id < count);
 	std::vector<uint32_t> column(column_height);
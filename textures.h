@@ -6,13 +6,27 @@
 #include <cstdint>
 #include <string>
 
+#include "utils.h"
+
 typedef struct Texture {
 	size_t img_w, img_h;		// image dimensions
 	size_t count, size;		// number of textures and size in pixels
+	size_t kernel_size;		// size (64 or 128) the render passes have kernels specialized for, 0 for the generic ones
 	std::vector<uint32_t> img;	// textures storage
+	PixelFormat format8;		// format of img8, RGBA32 while img8 is empty
+	std::vector<uint8_t> img8;	// 8-bit copy of img for the low precision render path
+	size_t shade_levels;		// number of light levels, 0 while the texture is unlit
+	uint32_t fog_color;		// color the last light level fades to
+	std::vector<uint32_t> shaded;	// shade_levels copies of img from level 0 (unlit) to full fog
+	std::vector<uint8_t> shaded8;	// same for img8
 	
 	Texture(const std::string filename);
+	void convert(const PixelFormat format); // fill img8, done once at load time rather than per texel fetch
+	void shade(const size_t levels, const uint32_t fog_color); // precompute the light levels so that lit rendering costs one lookup per texel like unlit
+	const uint32_t* pixels(const size_t level); // start of img or of its light level copy, laid out like img
+	const uint8_t* pixels8(const size_t level); // same for img8
 	uint32_t& get(const size_t i, const size_t j, const size_t idx); // get pixel (i, j) from the texture idx
+	uint8_t& get8(const size_t i, const size_t j, const size_t idx); // same as get() for the converted img8
 	std::vector<uint32_t> get_scaled_column(const size_t texture_id, const size_t texture_coord, const size_t column_height); // retrieve one column (texture_coord) from the texture_id and scale it to the destination size
 } Texture;
 
@@ -6,6 +6,14 @@
 #include <cassert>
 #include <sstream>
 #include <iomanip>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <sys/stat.h>
 
 #include "map.h"
 #include "utils.h"
@@ -13,107 +21,598 @@
 #include "framebuffer.h"
 #include "textures.h"
 #include "sprite.h"
+#include "render.h"
+#include "batch.h"
+#include "lightmap.h"
+#include "profile.h"
+#include "framecache.h"
+#include "stream.h"
+#include "qoi.h"
+#include "shmring.h"
+#include "resolution.h"
+#include "pvs.h"
+#include "los.h"
+#include "movement.h"
+#include "arena.h"
 
-int wall_x_texture_coord(const float hitx, const float hity, Texture &texture_walls) {
-	float x = hitx - floor(hitx + 0.5); // x and y contain (signed) fractional parts of hitx and hity,
-	float y = hity - floor(hity + 0.5); // they vary between -0.5 and +0.5, and one of them is supposed to be very close to 0
-	int texture = x * texture_walls.size;
-	
-	if (std::abs(y) > std::abs(x)) { // determine whether we hit a vertical or horizontal wall
-		texture = y * texture_walls.size;
+// render one 84x84 view per agent (./tinyraycaster batch [rgb|gray|indexed]), agents are spread over the empty cells of the map
+int run_batch(const PixelFormat format, Map& map, SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, const Lightmap& lightmap) {
+	std::vector<Player> players;
+	for (size_t n = 0; players.size() < 4096; n++) {
+		size_t cell = (n * 37) % (map.w * map.h);
+		if (!map.is_empty(cell % map.w, cell / map.w)) continue;
+		players.push_back(Player{cell % map.w + 0.5f, cell / map.w + 0.5f, static_cast<float>(n * 0.1), M_PI/3.0});
 	}
-	
-	if (texture < 0) { // handle case where x_texture_coord can be negative
-		texture += texture_walls.size;
+
+	std::vector<uint8_t> observations;
+	BatchStats stats = render_batch(players, 84, 84, format, map, sprites, texture_walls, texture_monsters, observations, 0, &lightmap);
+	PROFILE_DUMP("trace.json");
+	std::cout << stats.frames << " views in " << stats.seconds << "s on " << stats.threads << " threads: " << stats.fps << " views/s, " << stats.arena_high_water << " bytes of scratch per view" << std::endl;
+	return 0;
+}
+
+// time the walls and floor of a full turn with the column kernels specialized on the texture size and with the generic ones
+int run_kernels(Map& map, Player& player, Texture& texture_walls, const Lightmap& lightmap) {
+	const size_t kernel_sizes[2] = {texture_walls.kernel_size, 0};
+	const ViewTables tables(512, player.fov);
+	std::vector<RayHit> hits;
+	FrameBuffer fb[2] = {{512, 512, std::vector<uint32_t>()}, {512, 512, std::vector<uint32_t>()}};
+	std::chrono::duration<double> elapsed[2] = {};
+	size_t mismatches = 0;
+	for (size_t frame = 0; frame < 360; frame++) {
+		player.a += 2 * M_PI / 360;
+		cast_view(map, player, tables, hits);
+		for (size_t k = 0; k < 2; k++) {
+			texture_walls.kernel_size = kernel_sizes[k];
+			auto start = std::chrono::steady_clock::now();
+			fb[k].clear(pack_color(255, 255, 255));
+			draw_walls(fb[k], 0, tables, hits, map, texture_walls, &lightmap);
+			draw_floor(fb[k], 0, tables, hits, map, player, texture_walls, &lightmap);
+			elapsed[k] += std::chrono::steady_clock::now() - start;
+		}
+		mismatches += fb[0].img != fb[1].img;
+	}
+	texture_walls.kernel_size = kernel_sizes[0];
+	for (size_t k = 0; k < 2; k++) {
+		std::cout << "kernel size " << kernel_sizes[k] << (kernel_sizes[k] ? " (specialized): " : " (generic): ") << elapsed[k].count() / 360 * 1000 << " ms per frame" << std::endl;
+	}
+	std::cout << mismatches << " frames differ" << std::endl;
+	return mismatches ? -1 : 0;
+}
+
+// time the float and fixed point backends on the walls and floor of a full turn
+int run_backends(Map& map, Player& player, Texture& texture_walls, const Lightmap& lightmap) {
+	const RayBackend backends[2] = {RAY_FLOAT, RAY_FIXED};
+	const ViewTables tables[2] = {ViewTables(512, player.fov, RAY_FLOAT), ViewTables(512, player.fov, RAY_FIXED)};
+	std::vector<RayHit> hits;
+	FrameBuffer fb[2] = {{512, 512, std::vector<uint32_t>()}, {512, 512, std::vector<uint32_t>()}};
+	std::chrono::duration<double> elapsed[2] = {};
+	size_t differences = 0;
+	for (size_t frame = 0; frame < 360; frame++) {
+		player.a += 2 * M_PI / 360;
+		for (size_t b = 0; b < 2; b++) {
+			auto start = std::chrono::steady_clock::now();
+			fb[b].clear(pack_color(255, 255, 255));
+			cast_view(map, player, tables[b], hits);
+			draw_walls(fb[b], 0, tables[b], hits, map, texture_walls, &lightmap);
+			draw_floor(fb[b], 0, tables[b], hits, map, player, texture_walls, &lightmap);
+			elapsed[b] += std::chrono::steady_clock::now() - start;
+		}
+		for (size_t i = 0; i < fb[0].img.size(); i++) {
+			differences += fb[0].img[i] != fb[1].img[i];
+		}
+	}
+	for (size_t b = 0; b < 2; b++) {
+		std::cout << (backends[b] == RAY_FIXED ? "fixed point" : "float") << " backend: " << elapsed[b].count() / 360 * 1000 << " ms per frame" << std::endl;
+	}
+	std::cout << differences * 100. / (360 * fb[0].img.size()) << "% of the pixels differ between the backends" << std::endl;
+	return 0;
+}
+
+// compare interleaved frames with full ones while turning by whole columns then moving forward
+int run_interleave(Map& map, Player& player, SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, const Lightmap& lightmap, FrameBuffer& fb) {
+	FrameBuffer full = fb;
+	Interleave interleave;
+	std::chrono::duration<double> elapsed[2] = {};
+	size_t reused = 0, interpolated = 0;
+	double error = 0;
+	const size_t frames = 240;
+	for (size_t frame = 0; frame < frames; frame++) {
+		if (frame < frames / 2) {
+			player.a += 4 * player.fov / (fb.w / 2); // 4 columns
+		} else {
+			player.x += .01 * cos(player.a);
+			player.y += .01 * sin(player.a);
+		}
+		auto start = std::chrono::steady_clock::now();
+		render(full, map, player, sprites, texture_walls, texture_monsters, &lightmap);
+		auto middle = std::chrono::steady_clock::now();
+		render(fb, map, player, sprites, texture_walls, texture_monsters, &lightmap, nullptr, nullptr, RAY_FLOAT, 0, &interleave);
+		elapsed[0] += middle - start;
+		elapsed[1] += std::chrono::steady_clock::now() - middle;
+		reused += interleave.reused;
+		interpolated += interleave.interpolated;
+		for (size_t y = 0; y < fb.h; y++) {
+			for (size_t x = fb.w / 2; x < fb.w; x++) {
+				uint8_t r[2], g[2], b[2], a;
+				unpack_color(full.img[x + y * fb.w], r[0], g[0], b[0], a);
+				unpack_color(fb.img[x + y * fb.w], r[1], g[1], b[1], a);
+				error += std::abs(r[0] - r[1]) + std::abs(g[0] - g[1]) + std::abs(b[0] - b[1]);
+			}
+		}
+	}
+	std::cout << "full frames: " << elapsed[0].count() / frames * 1000 << " ms, interleaved: " << elapsed[1].count() / frames * 1000 << " ms" << std::endl;
+	std::cout << "filled columns: " << reused << " from the previous frame, " << interpolated << " from their neighbours" << std::endl;
+	std::cout << "mean absolute error: " << error / (frames * fb.h * fb.w / 2 * 3) << " per channel" << std::endl;
+	return 0;
+}
+
+// a full turn in 360 frames written to %05d.ppm or, with a stream name, to one sequence file,
+// finished frames are cached in memory and in ./cache
+int run_sweep(Map& map, Player& player, SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, const Lightmap& lightmap, FrameBuffer& fb, const std::string stream = "") {
+	mkdir("./cache", 0755);
+	FrameCache cache(64 << 20, "./cache");
+	const uint64_t scene = scene_version(map, sprites, &lightmap);
+	std::unique_ptr<StreamWriter> writer(stream.empty() ? nullptr : new StreamWriter(stream, fb.w, fb.h));
+	if (writer && !writer->is_open()) return -1;
+	std::vector<uint8_t> rgb;
+	for (size_t frame = 0; frame < 360; frame++) {
+		std::stringstream ss;
+		ss << std::setfill('0') << std::setw(5) << frame << ".ppm";
+		player.a += 2 * M_PI / 360;
+		FrameKey key = frame_key(player, fb, scene);
+		if (!cache.get(key, fb)) {
+			render(fb, map, player, sprites, texture_walls, texture_monsters, &lightmap);
+			cache.put(key, fb);
+		}
+		if (writer) {
+			writer->write(fb);
+		} else {
+			drop_ppm_image(ss.str(), fb, rgb);
+		}
+		fb.clear_dirty();
+	}
+	std::cout << "frame cache: " << cache.stats.hits << " hits, " << cache.stats.disk_hits << " disk hits, " << cache.stats.misses << " misses, " << (cache.stats.disk_bytes >> 20) << " MB on disk (" << cache.stats.disk_evictions << " files deleted)" << std::endl;
+	return 0;
+}
+
+// keep turning and publish every frame into the shared memory ring /tinyraycaster, see tools/ringreader.cpp,
+// with a budget (in ms) the view resolution is scaled to render each frame within it
+int run_ring(Map& map, Player& player, SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, const Lightmap& lightmap, FrameBuffer& fb, const size_t frames, const float budget_ms) {
+	FrameRing ring("/tinyraycaster", fb.w, fb.h, 8);
+	if (!ring.is_open()) return -1;
+	ResolutionScaler scaler(budget_ms > 0 ? budget_ms : 1);
+	for (size_t frame = 0; frame < frames; frame++) {
+		player.a += 2 * M_PI / 360;
+		auto start = std::chrono::steady_clock::now();
+		render(fb, map, player, sprites, texture_walls, texture_monsters, &lightmap, nullptr, nullptr, RAY_FLOAT, budget_ms > 0 ? scaler.columns(fb.w / 2) : 0);
+		std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		if (budget_ms > 0) scaler.update(elapsed.count());
+		ring.publish(fb);
+		fb.clear_dirty();
+	}
+	if (budget_ms > 0) {
+		const ResolutionStats& stats = scaler.stats;
+		std::cout << stats.frames << " frames, " << stats.over_budget << " over the " << budget_ms << " ms budget, " << stats.changes << " scale changes, mean scale " << stats.mean_scale() << std::endl;
+		for (size_t l = 0; l < scaler.levels.size(); l++) {
+			if (stats.frames_at[l]) std::cout << "  " << scaler.levels[l] << ": " << stats.frames_at[l] << " frames" << std::endl;
+		}
+	}
+	return 0;
+}
+
+// time line of sight queries between random points of the empty cells: one cast_ray each as the game
+// logic did, line_of_sight() one by one, and los_batch() without and with the PVS
+int run_los(Map& map, const size_t count) {
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> coord(0, 1);
+	const auto random_point = [&](float& x, float& y) {
+		do {
+			x = coord(rng) * map.w;
+			y = coord(rng) * map.h;
+		} while (!map.is_empty(x, y));
+	};
+	std::vector<LosQuery> queries(count);
+	for (size_t q = 0; q < count; q++) {
+		random_point(queries[q].x0, queries[q].y0);
+		random_point(queries[q].x1, queries[q].y1);
+	}
+	const LosGrid grid(map);
+	PVS pvs;
+	pvs.build(map);
+
+	std::vector<LosResult> results[4];
+	std::chrono::duration<double> elapsed[4] = {};
+	auto start = std::chrono::steady_clock::now();
+	results[0].resize(count);
+	for (size_t q = 0; q < count; q++) {
+		const LosQuery& query = queries[q];
+		const float dx = query.x1 - query.x0, dy = query.y1 - query.y0, len = std::sqrt(dx * dx + dy * dy);
+		const RayHit hit = len > 0 ? cast_ray(map, query.x0, query.y0, dx / len, dy / len, len) : RayHit{false};
+		results[0][q] = hit.hit ? LosResult{true, hit.dist, static_cast<int>(hit.i), static_cast<int>(hit.j)} : LosResult{false, len, -1, -1};
+	}
+	elapsed[0] = std::chrono::steady_clock::now() - start;
+	start = std::chrono::steady_clock::now();
+	results[1].resize(count);
+	for (size_t q = 0; q < count; q++) {
+		results[1][q] = line_of_sight(grid, queries[q]);
+	}
+	elapsed[1] = std::chrono::steady_clock::now() - start;
+	start = std::chrono::steady_clock::now();
+	los_batch(grid, queries, results[2]);
+	elapsed[2] = std::chrono::steady_clock::now() - start;
+	start = std::chrono::steady_clock::now();
+	los_batch(grid, queries, results[3], 0, &pvs);
+	elapsed[3] = std::chrono::steady_clock::now() - start;
+
+	const char* names[4] = {"cast_ray", "line_of_sight", "los_batch", "los_batch + PVS"};
+	size_t blocked = 0, mismatches[4] = {};
+	for (size_t q = 0; q < count; q++) {
+		blocked += results[2][q].hit;
+		for (size_t k = 0; k < 4; k++) {
+			mismatches[k] += results[k][q].hit != results[2][q].hit || (results[k][q].i != results[2][q].i && results[k][q].i != -1);
+		}
+	}
+	std::cout << count << " queries, " << blocked * 100. / count << "% blocked" << std::endl;
+	for (size_t k = 0; k < 4; k++) {
+		std::cout << names[k] << ": " << count / elapsed[k].count() / 1e6 << " M queries/s, " << mismatches[k] << " answers differ from los_batch" << std::endl;
+	}
+	return 0;
+}
+
+// move entities in empty cells for 100 ticks at 60 Hz, one at a time against Map::is_empty as the
+// game logic did and with move_batch(), and check that both end at the same places, outside the walls
+int run_move(Map& map, const size_t count) {
+	typedef struct Entity {
+		float x, y, vx, vy;
+	} Entity;
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> unit(-1, 1);
+	Movers movers(.2, 1);
+	std::vector<Entity> entities;
+	while (movers.size() < count) {
+		const size_t cell = rng() % (map.w * map.h);
+		if (!map.is_empty(cell % map.w, cell / map.w)) continue;
+		const Entity e{cell % map.w + .5f + .29f * unit(rng), cell / map.w + .5f + .29f * unit(rng), 3 * unit(rng), 3 * unit(rng)};
+		movers.add(e.x, e.y, e.vx, e.vy);
+		entities.push_back(e);
+	}
+	const LosGrid grid(map);
+	const size_t ticks = 100;
+	const float dt = 1 / 60.f, r = movers.radius, gap = 1e-3f;
+	std::chrono::duration<double> elapsed[2] = {};
+	for (size_t tick = 0; tick < ticks; tick++) {
+		auto start = std::chrono::steady_clock::now();
+		for (Entity& e : entities) {
+			const float x = e.x + e.vx * dt;
+			const int i = e.vx * dt > 0 ? x + r : x - r;
+			if (map.is_empty(i, e.y - r) && map.is_empty(i, e.y + r)) {
+				e.x = x;
+			} else {
+				e.x = e.vx * dt > 0 ? i - r - gap : i + 1 + r + gap;
+				e.vx = -movers.restitution * e.vx;
+			}
+			const float y = e.y + e.vy * dt;
+			const int j = e.vy * dt > 0 ? y + r : y - r;
+			if (map.is_empty(e.x - r, j) && map.is_empty(e.x + r, j)) {
+				e.y = y;
+			} else {
+				e.y = e.vy * dt > 0 ? j - r - gap : j + 1 + r + gap;
+				e.vy = -movers.restitution * e.vy;
+			}
+		}
+		auto middle = std::chrono::steady_clock::now();
+		move_batch(grid, movers, dt);
+		elapsed[0] += middle - start;
+		elapsed[1] += std::chrono::steady_clock::now() - middle;
 	}
-	assert(texture >= 0 && texture < static_cast<int>(texture_walls.size));
-	
-	return texture;
+	size_t mismatches = 0, in_walls = 0;
+	for (size_t k = 0; k < count; k++) {
+		mismatches += std::abs(entities[k].x - movers.x[k]) > 1e-4 || std::abs(entities[k].y - movers.y[k]) > 1e-4; // move_batch rounds stops differently
+		for (size_t corner = 0; corner < 4; corner++) {
+			in_walls += !map.is_empty(movers.x[k] + (corner & 1 ? r : -r), movers.y[k] + (corner & 2 ? r : -r));
+		}
+	}
+	std::cout << count << " entities, " << ticks << " ticks" << std::endl;
+	std::cout << "one at a time: " << elapsed[0].count() / ticks * 1000 << " ms per tick, move_batch: " << elapsed[1].count() / ticks * 1000 << " ms per tick" << std::endl;
+	std::cout << mismatches << " positions differ, " << in_walls << " corners in walls" << std::endl;
+	return mismatches || in_walls ? -1 : 0;
 }
 
-void draw_sprite(Sprite& sprite, FrameBuffer& fb, Player& player, Texture& texture_sprites) {
-	// absolute direction from the player to the sprite (in radians)
-	float sprite_dir = atan2(sprite.y - player.y, sprite.x - player.x);
-	
-	while (sprite_dir - player.a > M_PI) {
-		sprite_dir -= 2 * M_PI;
+// project random sprites around the player for 100 frames, one at a time with atan2, sqrt and pow as
+// draw_sprite did and all at once with project_sprites(), and compare the screen squares
+int run_sprites(const Player& player, const size_t count) {
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> coord(0, 16);
+	SpriteSet sprites;
+	for (size_t i = 0; i < count; i++) {
+		sprites.add(Sprite{coord(rng), coord(rng), 0});
+	}
+	const size_t view_w = 512, view_h = 512, frames = 100;
+	std::vector<int> h_offsets(count), sizes(count);
+	std::chrono::duration<double> elapsed[2] = {};
+	size_t mismatches = 0;
+	Player viewer = player;
+	for (size_t frame = 0; frame < frames; frame++) {
+		viewer.a += 2 * M_PI / frames;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < count; i++) {
+			float sprite_dir = atan2(sprites.y[i] - viewer.y, sprites.x[i] - viewer.x);
+			while (sprite_dir - viewer.a > M_PI) sprite_dir -= 2 * M_PI;
+			while (sprite_dir - viewer.a < -M_PI) sprite_dir += 2 * M_PI;
+			const float sprite_dist = std::sqrt(pow(viewer.x - sprites.x[i], 2) + pow(viewer.y - sprites.y[i], 2));
+			sizes[i] = sprite_dist * cos(sprite_dir - viewer.a) > SPRITE_NEAR ? std::min(1000, static_cast<int>(view_h / sprite_dist)) : 0;
+			h_offsets[i] = (sprite_dir - viewer.a) / viewer.fov * view_w + view_w / 2 - sizes[i] / 2;
+		}
+		auto middle = std::chrono::steady_clock::now();
+		ArenaFrame arena_frame;
+		SpriteProjection projection;
+		project_sprites(sprites, viewer, view_w, view_h, projection);
+		elapsed[0] += middle - start;
+		elapsed[1] += std::chrono::steady_clock::now() - middle;
+		for (size_t i = 0; i < count; i++) {
+			mismatches += sizes[i] != projection.size[i] || std::abs(h_offsets[i] - projection.h_offset[i]) > 1;
+		}
 	}
-	
-	while (sprite_dir - player.a < -M_PI) {
-		sprite_dir += 2*M_PI;
+	std::cout << count << " sprites: one at a time " << elapsed[0].count() / frames * 1000 << " ms per frame, project_sprites " << elapsed[1].count() / frames * 1000 << " ms per frame" << std::endl;
+	std::cout << mismatches << " screen squares differ by more than a column" << std::endl;
+	return 0;
+}
+
+// animate many sprites spread over the empty cells for 100 ticks at 60 Hz, then render them into out.ppm;
+// the 4 monster tiles play as one looping 4 frame sequence and as 4 rotations of a still one
+int run_animate(Map& map, Player& player, Texture& texture_walls, Texture& texture_monsters, const Lightmap& lightmap, FrameBuffer& fb, const size_t count) {
+	SpriteAtlas atlas(texture_monsters.count);
+	const uint32_t walk = atlas.add(0, 4, 1, .15), turn = atlas.add(0, 1, 4);
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> unit(0, 1);
+	SpriteSet sprites;
+	while (sprites.size() < count) {
+		const float x = unit(rng) * map.w, y = unit(rng) * map.h;
+		if (!map.is_empty(x, y)) continue;
+		sprites.add(x, y, rng() % 2 ? walk : turn, unit(rng), 2 * M_PI * unit(rng));
+	}
+	const size_t ticks = 100;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t tick = 0; tick < ticks; tick++) {
+		animate_sprites(sprites, atlas, 1 / 60.f);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << count << " sprites: " << elapsed.count() / ticks * 1000 << " ms per animation tick" << std::endl;
+	start = std::chrono::steady_clock::now();
+	render(fb, map, player, sprites, texture_walls, texture_monsters, &lightmap);
+	elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "frame rendered in " << elapsed.count() * 1000 << " ms" << std::endl;
+	drop_ppm_image("./out.ppm", fb.img, fb.w, fb.h);
+	return 0;
+}
+
+// toggle a few wall cells between wall and empty, one batch of edits per tick, and compare updating the
+// lightmap, PVS and line of sight grid incrementally (and rendering through the caches) with rebuilding them
+int run_edit(Map& map, Player& player, SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, Lightmap& lightmap, FrameBuffer& fb, const size_t ticks) {
+	const MapEdit doors[3] = { {6, 3, 0}, {6, 4, 0}, {10, 7, 1} }; // walls of the map, opened and closed in turn
+	PVS pvs;
+	pvs.build(map);
+	LosGrid grid(map);
+	FrameHistory history;
+	render(fb, map, player, sprites, texture_walls, texture_monsters, &lightmap, nullptr, &history);
+	double update_ms = 0, render_ms = 0, rebuild_ms = 0;
+	size_t mismatches = 0;
+	for (size_t tick = 0; tick < ticks; tick++) {
+		const MapEdit& door = doors[tick % 3];
+		std::vector<MapEdit> edits{ {door.i, door.j, map.is_empty(door.i, door.j) ? door.texture : -1} };
+		auto start = std::chrono::steady_clock::now();
+		map.edit(edits);
+		lightmap.update(map);
+		pvs.update(map);
+		grid.update(map);
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		update_ms += elapsed.count();
+		start = std::chrono::steady_clock::now();
+		render(fb, map, player, sprites, texture_walls, texture_monsters, &lightmap, nullptr, &history);
+		elapsed = std::chrono::steady_clock::now() - start;
+		render_ms += elapsed.count();
+
+		start = std::chrono::steady_clock::now();
+		Lightmap full_lightmap(map, lightmap.lights, lightmap.ambient);
+		PVS full_pvs;
+		full_pvs.build(map);
+		LosGrid full_grid(map);
+		elapsed = std::chrono::steady_clock::now() - start;
+		rebuild_ms += elapsed.count();
+		mismatches += full_lightmap.faces != lightmap.faces || full_lightmap.floor != lightmap.floor || full_pvs.bits != pvs.bits || full_grid.solid != grid.solid;
 	}
+	std::cout << ticks << " ticks of map edits: " << update_ms / ticks << " ms per incremental update against " << rebuild_ms / ticks << " ms per rebuild, " << render_ms / ticks << " ms per frame" << std::endl;
+	std::cout << mismatches << " ticks where the updated structures differ from the rebuilt ones" << std::endl;
+	drop_ppm_image("./out.ppm", fb.img, fb.w, fb.h);
+	return mismatches ? -1 : 0;
+}
 
-	float sprite_dist = std::sqrt(pow(player.x - sprite.x, 2) + pow(player.y - sprite.y, 2)); // distance from the player to the sprite
-	size_t sprite_screen_size = std::min(1000, static_cast<int>(fb.h/sprite_dist)); // screen sprite size
-	int h_offset = (sprite_dir - player.a)/player.fov*(fb.w/2) + (fb.w/2)/2 - texture_sprites.size/2; // do not forget the 3D view takes only a half of the framebuffer
-	int v_offset = fb.h/2 - sprite_screen_size/2;
+// add a gate of three doors in front of the player and two more doors, open and close them in turn for
+// a number of ticks at 60 Hz while answering line of sight queries and rendering through the caches, then
+// check the queries against cast_ray() and render out.ppm with the gate half open
+int run_doors(Map& map, Player& player, SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, Lightmap& lightmap, FrameBuffer& fb, const size_t ticks) {
+	map.add_door(1, 8, 4, false, 0, .8);
+	map.add_door(2, 8, 4, false, 0, .6);
+	map.add_door(3, 8, 4, false, 0, .4);
+	map.add_door(9, 3, 3, true);
+	map.add_door(1, 13, 3, false);
+	lightmap.update(map);
+	PVS pvs;
+	pvs.build(map);
+	LosGrid grid(map);
 
-	for (size_t i=0; i<sprite_screen_size; i++) {
-		if (h_offset+i<0 || h_offset+i>=fb.w/2) continue;
-		for (size_t j=0; j<sprite_screen_size; j++) {
-		    if (v_offset+j<0 || v_offset+j>=fb.h) continue;
-		    fb.set_pixel(fb.w/2 + h_offset+i, v_offset+j, pack_color(0,0,0));
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> coord(0, 1);
+	std::vector<LosQuery> queries(1 << 16);
+	for (size_t q = 0; q < queries.size(); q++) {
+		float* points[2][2] = { {&queries[q].x0, &queries[q].y0}, {&queries[q].x1, &queries[q].y1} };
+		for (size_t p = 0; p < 2; p++) {
+			do {
+				*points[p][0] = coord(rng) * map.w;
+				*points[p][1] = coord(rng) * map.h;
+			} while (!map.is_empty(*points[p][0], *points[p][1]));
+		}
+	}
+	std::vector<LosResult> results;
+	FrameHistory history;
+	double update_ms = 0, los_ms = 0, render_ms = 0;
+	size_t mismatches = 0, rebuilds = 0;
+	for (size_t tick = 0; tick < ticks; tick++) {
+		const uint64_t pvs_version = pvs.version, light_version = lightmap.version;
+		if (tick % 120 == 0) { // all doors start opening, or closing
+			for (size_t d = 0; d < map.doors.size(); d++) {
+				map.doors[d].target = tick % 240 ? 0 : 1;
+			}
+		}
+		auto start = std::chrono::steady_clock::now();
+		map.move_doors(1 / 60.f);
+		lightmap.update(map);
+		pvs.update(map);
+		grid.update(map);
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		update_ms += elapsed.count();
+		rebuilds += (pvs.version != pvs_version) + (lightmap.version != light_version);
+		start = std::chrono::steady_clock::now();
+		los_batch(grid, queries, results, 0, &pvs);
+		elapsed = std::chrono::steady_clock::now() - start;
+		los_ms += elapsed.count();
+		start = std::chrono::steady_clock::now();
+		render(fb, map, player, sprites, texture_walls, texture_monsters, &lightmap, nullptr, &history);
+		elapsed = std::chrono::steady_clock::now() - start;
+		render_ms += elapsed.count();
+		for (size_t q = 0; q < queries.size(); q += 64) {
+			const LosQuery& query = queries[q];
+			const float dx = query.x1 - query.x0, dy = query.y1 - query.y0, len = std::sqrt(dx * dx + dy * dy);
+			const RayHit hit = len > 0 ? cast_ray(map, query.x0, query.y0, dx / len, dy / len, len) : RayHit{false};
+			mismatches += hit.hit != results[q].hit || (results[q].i != -1 && (hit.i != static_cast<size_t>(results[q].i) || hit.j != static_cast<size_t>(results[q].j)));
 		}
 	}
+	std::cout << ticks << " ticks with " << map.doors.size() << " doors: " << update_ms / ticks << " ms per door update, " << los_ms / ticks << " ms per " << queries.size() << " line of sight queries, " << render_ms / ticks << " ms per frame" << std::endl;
+	std::cout << rebuilds << " lightmap or PVS updates, " << mismatches << " line of sight answers differ from cast_ray" << std::endl;
+	for (size_t d = 0; d < 3; d++) {
+		map.doors[d].target = .5f;
+	}
+	map.move_doors(10);
+	render(fb, map, player, sprites, texture_walls, texture_monsters, &lightmap);
+	drop_ppm_image("./out.ppm", fb.img, fb.w, fb.h);
+	return mismatches ? -1 : 0;
+}
 
+// decoded QOI image equals fb up to the alpha channel QOI drops
+static bool same_rgb(const std::vector<uint32_t>& image, const size_t w, const size_t h, const FrameBuffer& fb) {
+	if (w != fb.w || h != fb.h || image.size() != fb.img.size()) return false;
+	for (size_t i = 0; i < image.size(); i++) {
+		if (image[i] != (fb.img[i] | 0xff000000u)) return false;
+	}
+	return true;
 }
 
-void map_show_sprite(Sprite& sprite, FrameBuffer &fb, Map& map) {
-	const size_t rect_w = fb.w / (map.w * 2);
-	const size_t rect_h = fb.h / map.h;
-	fb.draw_rect(sprite.x * rect_w - 3, sprite.y * rect_h - 3, 6, 6, pack_color(255, 0, 0));
+// walk the sprites on small circles in front of the still camera for a number of frames rendered through a
+// FrameHistory, and hand every frame to the outputs that follow its dirty regions (RGB copy, QOI stripes,
+// sequence file, shared memory ring) and to the same outputs working on the whole frame, comparing both;
+// every QOI frame is decoded again and compared with the frame, the last one through outputs.qoi
+int run_outputs(Map& map, Player& player, SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, const Lightmap& lightmap, FrameBuffer& fb, const size_t frames) {
+	FrameRing ring("/tinyraycaster", fb.w, fb.h, 8), full_ring("/tinyraycaster_full", fb.w, fb.h, 8);
+	if (!ring.is_open() || !full_ring.is_open()) return -1;
+	StreamWriter seq("./outputs.seq", fb.w, fb.h), full_seq("./outputs_full.seq", fb.w, fb.h);
+	if (!seq.is_open() || !full_seq.is_open()) return -1;
+	const SpriteSet start = sprites;
+	FrameHistory history;
+	std::vector<uint8_t> rgb[2], qoi[2];
+	std::vector<uint32_t> decoded;
+	size_t decoded_w, decoded_h, roundtrip_errors = 0;
+	QoiEncoder encoder;
+	double elapsed_ms[2] = {};
+	size_t mismatches = 0;
+	for (size_t frame = 0; frame < frames; frame++) {
+		for (size_t i = 0; i < sprites.size(); i++) {
+			const float t = frame * .05f + i;
+			sprites.x[i] = start.x[i] + .3f * cos(t);
+			sprites.y[i] = start.y[i] + .3f * sin(t);
+		}
+		render(fb, map, player, sprites, texture_walls, texture_monsters, &lightmap, nullptr, &history);
+
+		auto begin = std::chrono::steady_clock::now();
+		to_rgb(fb, rgb[0]);
+		encoder.encode(fb, qoi[0]);
+		seq.write(fb);
+		const uint64_t published = ring.publish(fb);
+		auto middle = std::chrono::steady_clock::now();
+		rgb[1].clear();
+		to_rgb(fb, rgb[1]);
+		encode_qoi(fb.img, fb.w, fb.h, qoi[1]);
+		full_seq.write(fb.img);
+		full_ring.publish(fb.img);
+		auto end = std::chrono::steady_clock::now();
+		elapsed_ms[0] += std::chrono::duration<double, std::milli>(middle - begin).count();
+		elapsed_ms[1] += std::chrono::duration<double, std::milli>(end - middle).count();
+
+		uint64_t timestamp;
+		const uint32_t* slot = ring.acquire(published, timestamp);
+		mismatches += rgb[0] != rgb[1] || qoi[0] != qoi[1] || !slot || memcmp(slot, fb.img.data(), fb.img.size() * sizeof(uint32_t));
+		roundtrip_errors += !decode_qoi(qoi[0], decoded, decoded_w, decoded_h) || !same_rgb(decoded, decoded_w, decoded_h, fb);
+		if (frame + 1 == frames) {
+			drop_qoi_image("./outputs.qoi", fb, encoder);
+			roundtrip_errors += !load_qoi_image("./outputs.qoi", decoded, decoded_w, decoded_h) || !same_rgb(decoded, decoded_w, decoded_h, fb);
+		}
+		fb.clear_dirty();
+	}
+	seq.close();
+	full_seq.close();
+	std::string bytes[2];
+	const char* names[2] = {"./outputs.seq", "./outputs_full.seq"};
+	for (size_t f = 0; f < 2; f++) {
+		std::ifstream ifs(names[f], std::ios::binary);
+		bytes[f].assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+	}
+	std::cout << frames << " frames: " << elapsed_ms[0] / frames << " ms per frame of outputs from the dirty regions against " << elapsed_ms[1] / frames << " ms from the whole frame" << std::endl;
+	std::cout << mismatches << " frames whose RGB, QOI or ring output differs, the sequence files " << (bytes[0] == bytes[1] ? "match" : "differ") << std::endl;
+	std::cout << roundtrip_errors << " QOI images that do not decode back to the frame" << std::endl;
+	return mismatches || roundtrip_errors || bytes[0] != bytes[1] ? -1 : 0;
 }
 
-void render(FrameBuffer& fb, Map& map, Player& player, std::vector<Sprite> &sprites, Texture& texture_walls, Texture& texture_monster) {
-	fb.clear(pack_color(255, 255, 255)); // clear the screen
-	
-	const size_t rect_w = fb.w / (map.w * 2);
-	const size_t rect_h = fb.h / map.h;
+// load the potentially visible set of the map from ./map.pvs (building and saving it when missing or stale)
+// and render out.ppm with the map and sprites restricted to the cells visible from the player's cell
+int run_pvs(Map& map, Player& player, SpriteSet& sprites, Texture& texture_walls, Texture& texture_monsters, const Lightmap& lightmap, FrameBuffer& fb) {
+	PVS pvs;
+	if (!pvs.load("./map.pvs", map)) {
+		auto start = std::chrono::steady_clock::now();
+		pvs.build(map);
+		std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << "built the PVS in " << elapsed.count() << " ms" << std::endl;
+		if (!pvs.save("./map.pvs")) return -1;
+	}
+	struct stat st;
+	size_t empty = 0, visible = 0;
 	for (size_t j = 0; j < map.h; j++) {
 		for (size_t i = 0; i < map.w; i++) {
-			if (map.is_empty(i, j)) continue;
-			size_t rect_x = i * rect_w;
-			size_t rect_y = j * rect_h;
-			size_t texture_id = map.get(i, j);
-			assert(texture_id < texture_walls.count);
-			fb.draw_rect(rect_x, rect_y, rect_w, rect_h, texture_walls.get(0, 0, texture_id));
-		}
-	}
-
-	for (size_t i = 0; i < fb.w / 2; i++) {
-		float angle = player.a - player.fov / 2 + player.fov * i / static_cast<float>(fb.w / 2);
-		for (float t = 0; t < 20; t += 0.01) {
-			float x = player.x + t * cos(angle);
-			float y = player.y + t * sin(angle);
-			fb.set_pixel(x * rect_w, y * rect_h, pack_color(160, 160, 160));
-
-			if (map.is_empty(x, y)) continue;
-
-			size_t texture_id = map.get(x, y);
-			assert(texture_id < texture_walls.count);
-			//size_t column_height = fb.h / (t * cos(angle - player.a));
-			float dist = t * cos(angle - player.a);
-			size_t column_height = fb.h / dist;
-			int x_texture_coord = wall_x_texture_coord(x, y, texture_walls);
-			std::vector<uint32_t> column = texture_walls.get_scaled_column(texture_id, x_texture_coord, column_height);
-			int pix_x = i + fb.w / 2;
-			for (size_t j = 0; j < column_height; j++) {
-				int pix_y = j + fb.h / 2 - column_height / 2;
-				if (pix_y >= 0 && pix_y < static_cast<int>(fb.h)) {
-					fb.set_pixel(pix_x, pix_y, column[j]);
-				}
-			}
-			break;
+			if (!map.is_empty(i, j)) continue;
+			empty++;
+			visible += pvs.count(i, j);
 		}
 	}
+	std::cout << "map.pvs: " << (stat("./map.pvs", &st) ? 0 : st.st_size) << " bytes, on average " << 100. * visible / (empty * map.w * map.h) << "% of the cells visible from an empty cell" << std::endl;
+	render(fb, map, player, sprites, texture_walls, texture_monsters, &lightmap, nullptr, nullptr, RAY_FLOAT, 0, nullptr, &pvs);
+	drop_ppm_image("./out.ppm", fb.img, fb.w, fb.h);
+	return 0;
+}
 
-	for (size_t i = 0; i < sprites.size(); i++) {
-		map_show_sprite(sprites[i], fb, map);
-		draw_sprite(sprites[i], fb, player, texture_monster);
+int run_extract(const std::string stream, const size_t frame, const std::string filename) {
+	StreamReader reader(stream);
+	std::vector<uint32_t> image;
+	if (!reader.read(frame, image)) {
+		std::cerr << "Failed to read frame " << frame << " of " << stream << " (" << reader.frames() << " frames)" << std::endl;
+		return -1;
 	}
+	drop_image(filename, image, reader.w, reader.h);
+	return 0;
 }
 
-int main() {
+int main(int argc, char** argv) {
+	if (argc > 3 && std::string(argv[1]) == "extract") {
+		return run_extract(argv[2], std::stoul(argv[3]), argc > 4 ? argv[4] : "./out.ppm");
+	}
 	FrameBuffer fb{1024, 512, std::vector<uint32_t>(1024 * 512, pack_color(255, 255, 255))};
 	Player player{3.456, 2.345, 1.523, M_PI/3.0};
 	Map map;
@@ -123,20 +622,66 @@ int main() {
 		std::cerr << "Failed to load wall textures" << std::endl;
 		return -1;
 	}
+	texture_walls.shade(32, map.fog_color);
+	texture_monsters.shade(32, map.fog_color);
 
-	std::vector<Sprite> sprites{ {1.834, 8.765, 0}, {5.323, 5.365, 1}, {4.123, 10.265, 1} };
-	
-	/*
-	for (size_t frame = 0; frame < 360; frame++) {
-		std::stringstream ss;
-		ss << std::setfill('0') << std::setw(5) << frame << ".ppm";
-		player.a += 2 * M_PI / 360;
-		render(fb, map, player, texture_walls);
-		drop_ppm_image(ss.str(), fb.img, fb.w, fb.h);
+	SpriteSet sprites(std::vector<Sprite>{ {1.834, 8.765, 0}, {5.323, 5.365, 1}, {4.123, 10.265, 1} });
+	std::vector<Light> lights{ {3.5, 2.5, .8, 6}, {10.5, 6.5, 1, 8}, {5.5, 12.5, 1, 8} };
+	Lightmap lightmap(map, lights, .3);
+
+	if (argc > 1 && std::string(argv[1]) == "batch") {
+		std::string format = argc > 2 ? argv[2] : "gray";
+		return run_batch(format == "rgb" ? RGBA32 : format == "indexed" ? INDEXED8 : GRAY8, map, sprites, texture_walls, texture_monsters, lightmap);
+	}
+	if (argc > 1 && std::string(argv[1]) == "kernels") {
+		return run_kernels(map, player, texture_walls, lightmap);
+	}
+	if (argc > 1 && std::string(argv[1]) == "backends") {
+		return run_backends(map, player, texture_walls, lightmap);
+	}
+	if (argc > 1 && std::string(argv[1]) == "interleave") {
+		return run_interleave(map, player, sprites, texture_walls, texture_monsters, lightmap, fb);
+	}
+	if (argc > 1 && std::string(argv[1]) == "ring") {
+		return run_ring(map, player, sprites, texture_walls, texture_monsters, lightmap, fb, argc > 2 ? std::stoul(argv[2]) : 360, argc > 3 ? std::stof(argv[3]) : 0);
+	}
+	if (argc > 1 && std::string(argv[1]) == "los") {
+		return run_los(map, argc > 2 ? std::stoul(argv[2]) : 1 << 20);
+	}
+	if (argc > 1 && std::string(argv[1]) == "move") {
+		return run_move(map, argc > 2 ? std::stoul(argv[2]) : 100000);
+	}
+	if (argc > 1 && std::string(argv[1]) == "sprites") {
+		return run_sprites(player, argc > 2 ? std::stoul(argv[2]) : 100000);
+	}
+	if (argc > 1 && std::string(argv[1]) == "animate") {
+		return run_animate(map, player, texture_walls, texture_monsters, lightmap, fb, argc > 2 ? std::stoul(argv[2]) : 10000);
+	}
+	if (argc > 1 && std::string(argv[1]) == "edit") {
+		return run_edit(map, player, sprites, texture_walls, texture_monsters, lightmap, fb, argc > 2 ? std::stoul(argv[2]) : 30);
+	}
+	if (argc > 1 && std::string(argv[1]) == "doors") {
+		return run_doors(map, player, sprites, texture_walls, texture_monsters, lightmap, fb, argc > 2 ? std::stoul(argv[2]) : 480);
+	}
+	if (argc > 1 && std::string(argv[1]) == "outputs") {
+		return run_outputs(map, player, sprites, texture_walls, texture_monsters, lightmap, fb, argc > 2 ? std::stoul(argv[2]) : 240);
+	}
+	if (argc > 1 && std::string(argv[1]) == "pvs") {
+		return run_pvs(map, player, sprites, texture_walls, texture_monsters, lightmap, fb);
+	}
+	if (argc > 1 && std::string(argv[1]) == "sweep") {
+		return run_sweep(map, player, sprites, texture_walls, texture_monsters, lightmap, fb, argc > 2 ? argv[2] : "");
 	}
-	*/
 
-	render(fb, map, player, sprites, texture_walls, texture_monsters);
-	drop_ppm_image("./out.ppm", fb.img, fb.w, fb.h);
+	const bool fixed = argc > 1 && std::string(argv[1]) == "fixed";
+	if (fixed) {
+		argc--;
+		argv++;
+	}
+	AuxBuffers aux;
+	render(fb, map, player, sprites, texture_walls, texture_monsters, &lightmap, &aux, nullptr, fixed ? RAY_FIXED : RAY_FLOAT);
+	drop_image(argc > 1 ? argv[1] : "./out.ppm", fb.img, fb.w, fb.h);
+	drop_aux_image("./out.aux", aux.depth, aux.label, aux.w, aux.h);
+	PROFILE_DUMP("trace.json");
 	return 0;
 }
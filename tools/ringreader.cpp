@@ -0,0 +1,76 @@
+// Reference consumer of the frame ring published by `tinyraycaster ring`: follows the frames in
+// place, checks that they arrive in order and untorn, and reports the publish to read latency.
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+#include "shmring.h"
+
+int main(int argc, char** argv) {
+	const std::string name = argc > 1 ? argv[1] : "/tinyraycaster";
+	FrameRing* ring = nullptr;
+	for (int attempt = 0; attempt < 500; attempt++) { // wait 5 s for the renderer
+		ring = new FrameRing(name);
+		if (ring->is_open()) break;
+		delete ring;
+		ring = nullptr;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	if (!ring) {
+		std::cerr << "Failed to open the frame ring " << name << std::endl;
+		return -1;
+	}
+	const size_t npixels = ring->header->w * ring->header->h;
+	std::cout << "ring " << name << ": " << ring->header->slots << " slots of " << ring->header->w << "x" << ring->header->h << std::endl;
+
+	uint64_t last = 0, read = 0, dropped = 0, torn = 0, out_of_order = 0;
+	uint64_t latency_sum = 0, latency_max = 0, checksum = 0;
+	auto idle_since = std::chrono::steady_clock::now();
+	for (;;) {
+		const uint64_t head = ring->latest();
+		if (head == last) {
+			if (ring->header->closed.load(std::memory_order_acquire) || std::chrono::steady_clock::now() - idle_since > std::chrono::seconds(2)) break;
+			std::this_thread::yield();
+			continue;
+		}
+		idle_since = std::chrono::steady_clock::now();
+		if (head < last) {
+			out_of_order++;
+			last = head;
+			continue;
+		}
+		uint64_t next = std::max(last + 1, head >= ring->header->slots ? head - ring->header->slots + 1 : 1);
+		dropped += next - last - 1; // lapped by the writer before we got to them
+		for (; next <= head; next++) {
+			uint64_t timestamp;
+			const uint32_t* pixels = ring->acquire(next, timestamp);
+			if (!pixels) {
+				dropped++;
+				continue;
+			}
+			const uint64_t latency = ring_clock() - timestamp;
+			uint64_t sum = 0;
+			for (size_t i = 0; i < npixels; i++) { // stands for the real consumer work on the mapped frame
+				sum += pixels[i];
+			}
+			if (!ring->still_valid(next)) {
+				torn++;
+				continue;
+			}
+			checksum ^= sum;
+			latency_sum += latency;
+			latency_max = std::max(latency_max, latency);
+			read++;
+		}
+		last = head;
+	}
+	std::cout << read << " frames read, " << dropped << " dropped, " << torn << " torn, " << out_of_order << " out of order" << std::endl;
+	if (read) {
+		std::cout << "latency: mean " << latency_sum / read / 1000. << " us, max " << latency_max / 1000. << " us (checksum " << std::hex << checksum << ")" << std::endl;
+	}
+	delete ring;
+	return out_of_order ? 1 : 0;
+}
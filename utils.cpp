@@ -3,8 +3,12 @@
 #include <vector>
 #include <cstdint>
 #include <cassert>
+#include <atomic>
+#include <thread>
+#include <algorithm>
 
 #include "utils.h"
+#include "qoi.h"
 
 uint32_t pack_color(const uint8_t r, const uint8_t g, const uint8_t b, const uint8_t a) {
 	return (a << 24) + (b << 16) + (g << 8) + r;
@@ -17,14 +21,119 @@ void unpack_color(const uint32_t& color, uint8_t& r, uint8_t& g, uint8_t& b, uin
 	a = (color >> 24) & 255;
 }
 
+uint32_t blend_color(const uint32_t color, const uint32_t target, const float t) {
+	uint8_t r, g, b, a, tr, tg, tb, ta;
+	unpack_color(color, r, g, b, a);
+	unpack_color(target, tr, tg, tb, ta);
+	return pack_color(r + (tr - r) * t + .5f, g + (tg - g) * t + .5f, b + (tb - b) * t + .5f, a);
+}
+
+uint8_t convert_color(const uint32_t color, const PixelFormat format) {
+	assert(format == GRAY8 || format == INDEXED8);
+	uint8_t r, g, b, a;
+	unpack_color(color, r, g, b, a);
+	if (format == GRAY8) {
+		return (77 * r + 150 * g + 29 * b) >> 8; // integer BT.601 luma
+	}
+	return (r & 0xe0) | ((g & 0xe0) >> 3) | (b >> 6);
+}
+
+uint32_t palette_color(const uint8_t index) {
+	uint8_t r = index & 0xe0;
+	uint8_t g = (index << 3) & 0xe0;
+	uint8_t b = (index << 6) & 0xc0;
+	return pack_color(r | r >> 3 | r >> 6, g | g >> 3 | g >> 6, b | b >> 2 | b >> 4 | b >> 6); // replicate the high bits so that white stays white
+}
+
 void drop_ppm_image(const std::string filename, const std::vector<uint32_t>& image, const size_t w, const size_t h) {
 	assert(image.size() == w * h);
-	std::ofstream ofs(filename);
+	std::vector<char> rgb(w * h * 3);
+	for (size_t i = 0; i < h * w; ++i) {
+		rgb[i * 3 + 0] = image[i] & 255;
+		rgb[i * 3 + 1] = (image[i] >> 8) & 255;
+		rgb[i * 3 + 2] = (image[i] >> 16) & 255;
+	}
+	std::ofstream ofs(filename, std::ios::binary);
 	ofs << "P6\n" << w << " " << h << "\n255\n";
+	ofs.write(rgb.data(), rgb.size());
+	ofs.close();
+}
+
+void drop_ppm_image(const std::string filename, const FrameBuffer& fb, std::vector<uint8_t>& rgb) {
+	to_rgb(fb, rgb);
+	std::ofstream ofs(filename, std::ios::binary);
+	ofs << "P6\n" << fb.w << " " << fb.h << "\n255\n";
+	ofs.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+	ofs.close();
+}
+
+void drop_image(const std::string filename, const std::vector<uint32_t>& image, const size_t w, const size_t h) {
+	const std::string qoi = ".qoi";
+	if (filename.size() >= qoi.size() && filename.compare(filename.size() - qoi.size(), qoi.size(), qoi) == 0) {
+		drop_qoi_image(filename, image, w, h);
+	} else {
+		drop_ppm_image(filename, image, w, h);
+	}
+}
+
+void drop_ppm_image(const std::string filename, const std::vector<uint8_t>& image, const size_t w, const size_t h, const PixelFormat format) {
+	assert(image.size() == w * h && (format == GRAY8 || format == INDEXED8));
+	if (format == INDEXED8) {
+		std::vector<uint32_t> rgba(w * h);
+		for (size_t i = 0; i < h * w; ++i) {
+			rgba[i] = palette_color(image[i]);
+		}
+		drop_ppm_image(filename, rgba, w, h);
+		return;
+	}
+	std::ofstream ofs(filename);
+	ofs << "P5\n" << w << " " << h << "\n255\n";
+	ofs.write(reinterpret_cast<const char*>(image.data()), image.size());
+	ofs.close();
+}
+
+static void write_le(std::ofstream& ofs, const uint32_t value, const size_t bytes) {
+	for (size_t i = 0; i < bytes; i++) {
+		ofs << static_cast<char>((value >> (8 * i)) & 255);
+	}
+}
+
+void drop_aux_image(const std::string filename, const std::vector<float>& depth, const std::vector<uint16_t>& label, const size_t w, const size_t h) {
+	assert(depth.size() == w * h && label.size() == w * h);
+	std::ofstream ofs(filename, std::ios::binary);
+	ofs << "TRCAUX01";
+	write_le(ofs, w, 4);
+	write_le(ofs, h, 4);
 	for (size_t i = 0; i < h * w; ++i) {
-		uint8_t r, g, b, a;
-		unpack_color(image[i], r, g, b, a);
-		ofs << static_cast<char>(r) << static_cast<char>(g) << static_cast<char>(b);
+		float d = depth[i] * 256;
+		write_le(ofs, d < 0xffff ? static_cast<uint32_t>(d) : 0xffff, 2);
+	}
+	for (size_t i = 0; i < h * w; ++i) {
+		write_le(ofs, label[i], 2);
 	}
 	ofs.close();
 }
+
+size_t parallel_threads(const size_t n, const size_t chunk, size_t nthreads) {
+	assert(chunk > 0);
+	if (!nthreads) nthreads = std::max(1u, std::thread::hardware_concurrency());
+	return std::max(static_cast<size_t>(1), std::min(nthreads, (n + chunk - 1) / chunk));
+}
+
+void parallel_chunks(const size_t n, const size_t chunk, const size_t nthreads, const std::function<void(size_t, size_t, size_t)>& fn) {
+	const size_t count = parallel_threads(n, chunk, nthreads);
+	std::atomic<size_t> next(0);
+	auto worker = [&](const size_t t) {
+		for (size_t begin = chunk * next++; begin < n; begin = chunk * next++) {
+			fn(t, begin, std::min(begin + chunk, n));
+		}
+	};
+	std::vector<std::thread> threads;
+	for (size_t t = 1; t < count; t++) {
+		threads.push_back(std::thread(worker, t));
+	}
+	worker(0);
+	for (size_t t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+}
@@ -4,9 +4,34 @@
 #include <vector>
 #include <cstdint>
 #include <string>
+#include <functional>
+
+#include "framebuffer.h"
+
+enum PixelFormat {
+	RGBA32,		// packed 32-bit colors, see pack_color
+	GRAY8,		// 8-bit luma
+	INDEXED8	// 8-bit index into the fixed 3-3-2 RGB palette, see palette_color
+};
 
 uint32_t pack_color(const uint8_t r, const uint8_t g, const uint8_t b, const uint8_t a = 255);
 void unpack_color(const uint32_t& color, uint8_t& r, uint8_t& g, uint8_t& b, uint8_t& a);
+uint32_t blend_color(const uint32_t color, const uint32_t target, const float t); // per channel lerp from color (t = 0) to target (t = 1)
+uint8_t convert_color(const uint32_t color, const PixelFormat format); // packed color to a GRAY8 or INDEXED8 pixel
+uint32_t palette_color(const uint8_t index); // packed color of an INDEXED8 pixel
 void drop_ppm_image(const std::string filename, const std::vector<uint32_t>& image, const size_t w, const size_t h);
+void drop_image(const std::string filename, const std::vector<uint32_t>& image, const size_t w, const size_t h); // QOI for a .qoi filename, PPM otherwise
+void drop_ppm_image(const std::string filename, const FrameBuffer& fb, std::vector<uint8_t>& rgb); // rgb: the copy of the previous frame, updated by to_rgb
+void drop_ppm_image(const std::string filename, const std::vector<uint8_t>& image, const size_t w, const size_t h, const PixelFormat format); // PGM for GRAY8, PPM for INDEXED8
+
+// binary dump of AuxBuffers: the 8 bytes "TRCAUX01", uint32 w, uint32 h, then w*h uint16 depths in
+// 1/256 map units (0xffff for no hit or too far) and w*h uint16 labels, all little endian
+void drop_aux_image(const std::string filename, const std::vector<float>& depth, const std::vector<uint16_t>& label, const size_t w, const size_t h);
+
+// Split [0, n) into chunks of chunk items and call fn(thread, begin, end) for each, the chunks being
+// taken in turn by the calling thread (thread 0) and up to nthreads - 1 others; nthreads = 0 picks
+// std::thread::hardware_concurrency(). parallel_threads() is the number of threads that runs.
+size_t parallel_threads(const size_t n, const size_t chunk, size_t nthreads);
+void parallel_chunks(const size_t n, const size_t chunk, const size_t nthreads, const std::function<void(size_t, size_t, size_t)>& fn);
 
 #endif